@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "parser.h"
+#include "utils.h"
+
+#define ARENA_ALIGNMENT _Alignof (max_align_t)
+
+/*
+ * Offset of the next properly aligned address in `block`.
+ */
+static size_t
+aligned_offset (arena_block_t *block)
+{
+  uintptr_t address = (uintptr_t) (block->data + block->used);
+  uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~((uintptr_t) ARENA_ALIGNMENT - 1);
+  return block->used + (aligned - address);
+}
+
+/*
+ * Get a new block of memory able to hold at least `len` bytes.
+ *
+ * Standard blocks are taken from the spare ones when there are any.
+ * Big allocations get a block of their own, put behind the current
+ * one so we can keep filling the latter.
+ */
+static arena_block_t *
+add_block (arena_t *arena, size_t len)
+{
+  size_t size = len + ARENA_ALIGNMENT > ARENA_BLOCK_SIZE ? len + ARENA_ALIGNMENT : ARENA_BLOCK_SIZE;
+  arena_block_t *block = NULL;
+
+  if (size == ARENA_BLOCK_SIZE && arena->spare)
+    {
+      block = arena->spare;
+      arena->spare = block->next;
+      block->used = 0;
+    }
+  else
+    {
+      block = xalloc (sizeof *block + size);
+      block->size = size;
+    }
+
+  if (arena->blocks && size > ARENA_BLOCK_SIZE)
+    {
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    }
+  else
+    {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+
+  return block;
+}
+
+/*
+ * Allocate `len` bytes of zeroed memory.
+ */
+void *
+arena_alloc (arena_t *arena, size_t len)
+{
+  arena_block_t *block = arena->blocks;
+  size_t offset = block ? aligned_offset (block) : 0;
+
+  if (!block || offset + len > block->size)
+    {
+      block = add_block (arena, len);
+      offset = aligned_offset (block);
+    }
+
+  void *mem = block->data + offset;
+  block->used = offset + len;
+  memset (mem, 0, len);
+
+  return mem;
+}
+
+/*
+ * Resize memory previously given by `arena_alloc()`.
+ *
+ * If `mem` is the last allocation of the current block, it's grown
+ * in place when possible. Otherwise, content is copied to a new
+ * allocation (the old one is only reclaimed on `arena_release()`).
+ *
+ * Added memory is not zeroed.
+ */
+void *
+arena_realloc (arena_t *arena, void *mem, size_t old_len, size_t new_len)
+{
+  if (!mem)
+    return arena_alloc (arena, new_len);
+
+  if (new_len <= old_len)
+    return mem;
+
+  arena_block_t *block = arena->blocks;
+  if (block && (char *) mem + old_len == block->data + block->used && (size_t) ((char *) mem - block->data) + new_len <= block->size)
+    {
+      block->used += new_len - old_len;
+      return mem;
+    }
+
+  void *new_mem = arena_alloc (arena, new_len);
+  memcpy (new_mem, mem, old_len);
+
+  return new_mem;
+}
+
+/*
+ * Forget all allocations, so the arena can be used for a new document.
+ *
+ * Standard blocks are kept as spare ones, to be reused without going
+ * through the allocator again. Big blocks are freed.
+ */
+void
+arena_reset (arena_t *arena)
+{
+  arena_block_t *block = arena->blocks;
+  while (block)
+    {
+      arena_block_t *next = block->next;
+      if (block->size == ARENA_BLOCK_SIZE)
+        {
+          block->next = arena->spare;
+          arena->spare = block;
+        }
+      else
+        free (block);
+
+      block = next;
+    }
+
+  arena->blocks = NULL;
+}
+
+/*
+ * Free all memory owned by the arena.
+ */
+void
+arena_release (arena_t *arena)
+{
+  arena_reset (arena);
+
+  arena_block_t *block = arena->spare;
+  while (block)
+    {
+      arena_block_t *next = block->next;
+      free (block);
+      block = next;
+    }
+
+  arena->spare = NULL;
+}
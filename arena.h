@@ -0,0 +1,30 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct _arena_block_t {
+  struct _arena_block_t *next;
+  size_t size;
+  size_t used;
+  char data[];
+} arena_block_t;
+
+/*
+ * Bump allocator owning all memory of a document.
+ *
+ * Allocations are never freed individually: everything is released
+ * at once with `arena_release()`, or forgotten with `arena_reset()`,
+ * which keeps standard blocks in `spare` for the next document.
+ */
+typedef struct {
+  arena_block_t *blocks;
+  arena_block_t *spare;
+} arena_t;
+
+void *arena_alloc (arena_t *arena, size_t len);
+void *arena_realloc (arena_t *arena, void *mem, size_t old_len, size_t new_len);
+void arena_reset (arena_t *arena);
+void arena_release (arena_t *arena);
+
+#endif
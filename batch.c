@@ -0,0 +1,1079 @@
+/*
+ * Conversion of many files in the same process.
+ *
+ * All int returning functions returns non-zero in case of error, unless
+ * explicitly mentioned.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "parser.h"
+#include "sink.h"
+#include "utils.h"
+#include "wiki2md.h"
+#include "xml_reader.h"
+
+/*
+ * Files waiting to be converted, as indexes in the batch paths.
+ *
+ * The owner takes jobs from the bottom, other workers steal them from
+ * the top, so a worker busy on a big file doesn't hold back the files
+ * queued behind it.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t *jobs;
+  size_t top;
+  size_t bottom;
+} deque_t;
+
+/*
+ * Identity of a file, whatever the path used to reach it.
+ */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} file_id_t;
+
+/*
+ * Output paths given so far, so two inputs never write the same file,
+ * and input files, so no output is ever written over them.
+ *
+ * Paths are an open addressing hash table, which is never more than
+ * half full. They're owned by the set.
+ */
+typedef struct {
+  char **paths;
+  size_t capacity;
+  size_t count;
+  file_id_t *inputs; // sorted, see `path_set_protect()`.
+  size_t inputs_count;
+} path_set_t;
+
+typedef struct _batch_t batch_t;
+typedef struct _pipeline_t pipeline_t;
+
+/*
+ * Per thread state. Nothing in it is shared, except the deque.
+ */
+typedef struct {
+  size_t id;
+  batch_t *batch;
+  pipeline_t *pipeline;
+  pthread_t thread;
+  bool started;
+  w2m_ctx_t *ctx;
+  sink_t sink;
+  size_t failures;
+  deque_t deque;
+} worker_t;
+
+struct _batch_t {
+  char **paths;
+  char **outputs; // markdown file of each of `paths`, owned by `claimed`.
+  size_t count;
+  path_set_t claimed;
+  worker_t *workers;
+  size_t workers_count;
+};
+
+/*
+ * A page going through the dump pipeline, with its markdown when
+ * it's converted to a single stream.
+ */
+typedef struct {
+  xml_page_t page;
+  char *path; // markdown file of the page, owned by `claimed` of the pipeline.
+  sink_t output;
+  bool converted;
+  bool failed;
+} slot_t;
+
+/*
+ * Dump conversion pipeline: the reader puts pages in a ring of slots,
+ * workers convert them, and the writer outputs them in order before
+ * giving slots back to the reader.
+ *
+ * Counters only ever grow, a page number modulo `slots_count` giving
+ * its slot. The reader waits when all slots are yet to be written,
+ * which bounds memory use whatever the size of the dump.
+ */
+struct _pipeline_t {
+  pthread_mutex_t lock;
+  pthread_cond_t slot_freed;
+  pthread_cond_t page_read;
+  pthread_cond_t page_converted;
+  slot_t *slots;
+  size_t slots_count;
+  size_t read_count;
+  size_t claimed_count;
+  size_t written_count;
+  bool reading_done;
+  const char *output_dir;
+  path_set_t claimed; // only used by the reader.
+  char *path;
+  size_t path_capacity;
+  size_t failures;
+};
+
+/*
+ * Prepare `deque` to hold up to `capacity` jobs.
+ */
+static void
+deque_init (deque_t *deque, size_t capacity)
+{
+  pthread_mutex_init (&deque->lock, NULL);
+  deque->jobs = xalloc ((capacity ? capacity : 1) * sizeof *deque->jobs);
+  deque->top = 0;
+  deque->bottom = 0;
+}
+
+/*
+ * Queue `job`. Only used before workers are started.
+ */
+static void
+deque_push (deque_t *deque, size_t job)
+{
+  deque->jobs[deque->bottom++] = job;
+}
+
+/*
+ * Take the most recently queued job, for the owner of `deque`.
+ *
+ * Returns false if the deque is empty.
+ */
+static bool
+deque_pop (deque_t *deque, size_t *job)
+{
+  pthread_mutex_lock (&deque->lock);
+  bool found = deque->bottom > deque->top;
+  if (found)
+    *job = deque->jobs[--deque->bottom];
+  pthread_mutex_unlock (&deque->lock);
+
+  return found;
+}
+
+/*
+ * Take the oldest queued job, for workers other than the owner.
+ *
+ * Returns false if the deque is empty.
+ */
+static bool
+deque_steal (deque_t *deque, size_t *job)
+{
+  pthread_mutex_lock (&deque->lock);
+  bool found = deque->bottom > deque->top;
+  if (found)
+    *job = deque->jobs[deque->top++];
+  pthread_mutex_unlock (&deque->lock);
+
+  return found;
+}
+
+/*
+ * Release memory of `deque`.
+ */
+static void
+deque_release (deque_t *deque)
+{
+  pthread_mutex_destroy (&deque->lock);
+  free (deque->jobs);
+}
+
+/*
+ * FNV-1a hash of `path`.
+ */
+static size_t
+hash_path (const char *path)
+{
+  size_t hash = 14695981039346656037ULL;
+  for (const unsigned char *c = (const unsigned char *) path; *c; c++)
+    hash = (hash ^ *c) * 1099511628211ULL;
+
+  return hash;
+}
+
+/*
+ * Slot of `path` in `set`, which is either NULL or the same path.
+ */
+static char **
+path_set_slot (path_set_t *set, const char *path)
+{
+  size_t i = hash_path (path) & (set->capacity - 1);
+  while (set->paths[i] && strcmp (set->paths[i], path) != 0)
+    i = (i + 1) & (set->capacity - 1);
+
+  return &set->paths[i];
+}
+
+/*
+ * Add a copy of `path` to `set`.
+ *
+ * Returns the copy, or NULL if `path` was in `set` already.
+ */
+static char *
+path_set_add (path_set_t *set, const char *path)
+{
+  if ((set->count + 1) * 2 > set->capacity)
+    {
+      path_set_t grown = *set;
+      grown.capacity = set->capacity ? set->capacity * 2 : 64;
+
+      grown.paths = xalloc (grown.capacity * sizeof *grown.paths);
+      for (size_t i = 0; i < set->capacity; i++)
+        if (set->paths[i])
+          *path_set_slot (&grown, set->paths[i]) = set->paths[i];
+
+      free (set->paths);
+      *set = grown;
+    }
+
+  char **slot = path_set_slot (set, path);
+  if (*slot)
+    return NULL;
+
+  size_t len = strlen (path) + 1;
+  *slot = memcpy (xalloc (len), path, len);
+  set->count++;
+
+  return *slot;
+}
+
+/*
+ * Order of file ids, for `qsort()` and `bsearch()`.
+ */
+static int
+compare_file_ids (const void *a, const void *b)
+{
+  const file_id_t *left = a;
+  const file_id_t *right = b;
+
+  if (left->dev != right->dev)
+    return left->dev < right->dev ? -1 : 1;
+
+  if (left->ino != right->ino)
+    return left->ino < right->ino ? -1 : 1;
+
+  return 0;
+}
+
+/*
+ * Record the `count` input files of `paths` in `set`, so no output is
+ * claimed over them, whatever the path leading to them. Files which
+ * can't be found are skipped, they can't be overwritten.
+ */
+static void
+path_set_protect (path_set_t *set, char **paths, size_t count)
+{
+  struct stat info;
+
+  set->inputs = xalloc ((count ? count : 1) * sizeof *set->inputs);
+  for (size_t i = 0; i < count; i++)
+    if (stat (paths[i], &info) == 0)
+      set->inputs[set->inputs_count++] = (file_id_t) { .dev = info.st_dev, .ino = info.st_ino };
+
+  qsort (set->inputs, set->inputs_count, sizeof *set->inputs, compare_file_ids);
+}
+
+/*
+ * Tell if `path` is one of the input files of `set`.
+ */
+static bool
+path_set_is_input (path_set_t *set, const char *path)
+{
+  struct stat info;
+
+  if (!set->inputs_count || stat (path, &info) != 0)
+    return false;
+
+  file_id_t id = { .dev = info.st_dev, .ino = info.st_ino };
+
+  return bsearch (&id, set->inputs, set->inputs_count, sizeof *set->inputs, compare_file_ids) != NULL;
+}
+
+/*
+ * Add a copy of `path` to `set`, unless it's an input file.
+ *
+ * Returns the copy, or NULL if `path` can't be an output.
+ */
+static char *
+path_set_add_output (path_set_t *set, const char *path)
+{
+  if (path_set_is_input (set, path))
+    return NULL;
+
+  return path_set_add (set, path);
+}
+
+/*
+ * Release memory of `set`, including its paths.
+ */
+static void
+path_set_release (path_set_t *set)
+{
+  for (size_t i = 0; i < set->capacity; i++)
+    free (set->paths[i]);
+
+  free (set->paths);
+  free (set->inputs);
+  memset (set, 0, sizeof *set);
+}
+
+/*
+ * Reserve the markdown file `path` (ending with `.md`) in `claimed`.
+ *
+ * When another input has it already, or when it's an input file
+ * itself, a numeric suffix is added to the name, until it's one
+ * nobody has.
+ *
+ * Returns the reserved path, owned by `claimed`.
+ */
+static char *
+claim_output_path (path_set_t *claimed, const char *path)
+{
+  char *claimed_path = path_set_add_output (claimed, path);
+  if (claimed_path)
+    return claimed_path;
+
+  size_t stem_len = strlen (path) - strlen (".md");
+  size_t needed = stem_len + sizeof "_18446744073709551615.md";
+  char *unique = xalloc (needed);
+
+  for (size_t suffix = 2; !claimed_path; suffix++)
+    {
+      snprintf (unique, needed, "%.*s_%zu.md", (int) stem_len, path, suffix);
+      claimed_path = path_set_add_output (claimed, unique);
+    }
+
+  fprintf (stderr, "batch.c : claim_output_path() : %s is an input or the output of another input already, writing to %s instead.\n", path, claimed_path);
+  free (unique);
+
+  return claimed_path;
+}
+
+/*
+ * Create `output_dir` if it doesn't exist yet, so files can be
+ * created in it. Its parent must exist.
+ */
+static int
+make_output_dir (const char *output_dir)
+{
+  struct stat info;
+
+  if (mkdir (output_dir, 0777) == 0)
+    return 0;
+
+  if (errno != EEXIST)
+    {
+      fprintf (stderr, "batch.c : make_output_dir() : can't create %s : %s\n", output_dir, strerror (errno));
+      return 1;
+    }
+
+  if (stat (output_dir, &info) != 0 || !S_ISDIR (info.st_mode))
+    {
+      fprintf (stderr, "batch.c : make_output_dir() : %s is not a directory.\n", output_dir);
+      return 1;
+    }
+
+  return 0;
+}
+
+/*
+ * Build in `*buffer` the path of the markdown file for `filename`:
+ * its name with a `.md` extension, next to it, or in `output_dir`
+ * when provided.
+ */
+static char *
+output_path (char **buffer, size_t *capacity, const char *filename, const char *output_dir)
+{
+  const char *base = strrchr (filename, '/');
+  base = base ? base + 1 : filename;
+
+  const char *extension = strrchr (base, '.');
+  size_t stem_len = extension && extension != base ? (size_t) (extension - base) : strlen (base);
+
+  const char *dir = output_dir ? output_dir : filename;
+  size_t dir_len = output_dir ? strlen (output_dir) : (size_t) (base - filename);
+  const char *separator = output_dir && dir_len > 0 && output_dir[dir_len - 1] != '/' ? "/" : "";
+
+  size_t needed = dir_len + 1 + stem_len + sizeof ".md";
+  if (needed > *capacity)
+    {
+      *buffer = xrealloc (*buffer, needed);
+      *capacity = needed;
+    }
+
+  snprintf (*buffer, *capacity, "%.*s%s%.*s.md", (int) dir_len, dir, separator, (int) stem_len, base);
+
+  return *buffer;
+}
+
+/*
+ * Build in `*buffer` the path of the markdown file for a page named
+ * `title` in `output_dir`. Slashes (subpages) can't be part of a file
+ * name, they're replaced with underscores.
+ */
+static char *
+title_path (char **buffer, size_t *capacity, const char *title, size_t title_len, const char *output_dir)
+{
+  size_t dir_len = strlen (output_dir);
+  const char *separator = dir_len > 0 && output_dir[dir_len - 1] != '/' ? "/" : "";
+
+  size_t needed = dir_len + 1 + title_len + sizeof ".md";
+  if (needed > *capacity)
+    {
+      *buffer = xrealloc (*buffer, needed);
+      *capacity = needed;
+    }
+
+  int prefix_len = snprintf (*buffer, *capacity, "%s%s", output_dir, separator);
+  char *name = *buffer + prefix_len;
+  memcpy (name, title, title_len);
+  for (size_t i = 0; i < title_len; i++)
+    if (name[i] == '/')
+      name[i] = '_';
+
+  memcpy (name + title_len, ".md", sizeof ".md");
+
+  return *buffer;
+}
+
+/*
+ * Convert the file `filename`, or `page` if it's not NULL, to the
+ * markdown file `path`, with the context and output buffer of `worker`.
+ *
+ * Markdown is written to a temporary file next to `path`, which only
+ * replaces it once conversion succeeded, so a failure never leaves a
+ * truncated file, nor removes an existing one.
+ */
+static int
+write_markdown (worker_t *worker, const char *path, const char *filename, const xml_page_t *page)
+{
+  sink_t *sink = &worker->sink;
+  size_t tmp_len = strlen (path) + sizeof ".XXXXXX";
+  char *tmp_path = xalloc (tmp_len);
+  snprintf (tmp_path, tmp_len, "%s.XXXXXX", path);
+
+  int fd = mkstemp (tmp_path);
+  if (fd < 0)
+    {
+      fprintf (stderr, "batch.c : write_markdown() : can't create %s : %s\n", tmp_path, strerror (errno));
+      free (tmp_path);
+      return 1;
+    }
+
+  // mkstemp() only lets the owner read it.
+  fchmod (fd, 0644);
+
+  sink_attach (sink, fd);
+  int err = page ? w2m_convert (worker->ctx, page->text, page->text_len, sink) : w2m_convert_file (worker->ctx, filename, sink);
+  sink_attach (sink, -1);
+
+  if (close (fd) != 0 && !err)
+    {
+      fprintf (stderr, "batch.c : write_markdown() : can't write %s : %s\n", tmp_path, strerror (errno));
+      err = 1;
+    }
+
+  if (!err && rename (tmp_path, path) != 0)
+    {
+      fprintf (stderr, "batch.c : write_markdown() : can't write %s : %s\n", path, strerror (errno));
+      err = 1;
+    }
+
+  if (err)
+    unlink (tmp_path);
+
+  free (tmp_path);
+
+  return err;
+}
+
+/*
+ * Convert `filename` to the markdown file `path`, with the context and
+ * output buffer of `worker`.
+ */
+static int
+convert_file (worker_t *worker, const char *filename, const char *path)
+{
+  return write_markdown (worker, path, filename, NULL);
+}
+
+/*
+ * Claim in `claimed` the markdown file of `page` in `output_dir`, its
+ * path being built in `*buffer`, like for files in `batch_convert()`.
+ *
+ * Returns NULL for a page without title, which can't have a file.
+ */
+static char *
+claim_page_path (path_set_t *claimed, char **buffer, size_t *capacity, const xml_page_t *page, const char *output_dir)
+{
+  if (page->title_len == 0)
+    return NULL;
+
+  title_path (buffer, capacity, page->title, page->title_len, output_dir);
+
+  return claim_output_path (claimed, *buffer);
+}
+
+/*
+ * Convert a page of a dump, either to its own file `path` in
+ * `output_dir`, or to `stream` after a title heading when there is
+ * no `output_dir`.
+ */
+static int
+convert_page (worker_t *worker, const xml_page_t *page, const char *output_dir, const char *path, sink_t *stream)
+{
+  if (output_dir)
+    {
+      if (!path)
+        {
+          fprintf (stderr, "batch.c : convert_page() : page without title.\n");
+          return 1;
+        }
+
+      return write_markdown (worker, path, NULL, page);
+    }
+
+  int err = sink_reserve (stream, page->title_len + 4);
+  if (err)
+    {
+      fprintf (stderr, "batch.c : convert_page() : can't write title.\n");
+      return err;
+    }
+
+  SINK_APPEND_LITERAL (stream, "# ");
+  sink_append (stream, page->title, page->title_len);
+  SINK_APPEND_LITERAL (stream, "\n\n");
+
+  return w2m_convert (worker->ctx, page->text, page->text_len, stream);
+}
+
+/*
+ * Read a list of NUL separated paths from `file`.
+ *
+ * The last path doesn't need to be NUL terminated.
+ */
+int
+batch_read_list (file_list_t *list, FILE *file)
+{
+  memset (list, 0, sizeof *list);
+
+  size_t len = 0;
+  size_t capacity = BUFSIZ;
+  list->content = xalloc (capacity);
+
+  while (true)
+    {
+      len += fread (list->content + len, 1, capacity - len - 1, file);
+      if (ferror (file))
+        {
+          fprintf (stderr, "batch.c : batch_read_list() : error while reading list.\n");
+          return 1;
+        }
+
+      if (feof (file))
+        break;
+
+      capacity *= 2;
+      list->content = xrealloc (list->content, capacity);
+    }
+
+  list->content[len] = 0;
+
+  size_t paths_capacity = 0;
+  char *end = list->content + len;
+  for (char *path = list->content; path < end; path += strlen (path) + 1)
+    {
+      if (!path[0])
+        continue;
+
+      if (list->count == paths_capacity)
+        {
+          paths_capacity = paths_capacity ? paths_capacity * 2 : 64;
+          list->paths = xrealloc (list->paths, paths_capacity * sizeof *list->paths);
+        }
+
+      list->paths[list->count++] = path;
+    }
+
+  return 0;
+}
+
+/*
+ * Release memory of a list read by `batch_read_list()`.
+ */
+void
+batch_free_list (file_list_t *list)
+{
+  free (list->paths);
+  free (list->content);
+  memset (list, 0, sizeof *list);
+}
+
+/*
+ * Take the next job of `worker`, or steal one from an other worker
+ * when it has none left.
+ *
+ * No job is added once workers are started, so when a full round
+ * finds nothing, everything has been taken.
+ */
+static bool
+take_job (worker_t *worker, size_t *job)
+{
+  if (deque_pop (&worker->deque, job))
+    return true;
+
+  batch_t *batch = worker->batch;
+  for (size_t i = 1; i < batch->workers_count; i++)
+    {
+      worker_t *victim = &batch->workers[(worker->id + i) % batch->workers_count];
+      if (deque_steal (&victim->deque, job))
+        return true;
+    }
+
+  return false;
+}
+
+/*
+ * Worker thread: convert files until there is none left.
+ */
+static void *
+work (void *data)
+{
+  worker_t *worker = data;
+  batch_t *batch = worker->batch;
+  size_t job = 0;
+
+  while (take_job (worker, &job))
+    {
+      int err = convert_file (worker, batch->paths[job], batch->outputs[job]);
+      if (err)
+        {
+          fprintf (stderr, "batch.c : work() : can't convert file %s\n", batch->paths[job]);
+          worker->failures++;
+        }
+    }
+
+  return NULL;
+}
+
+/*
+ * Convert each file of `paths` to a markdown file, on `jobs` threads.
+ *
+ * Each worker has its own conversion context and output buffer, reused
+ * for all the files it converts. Files are dealt to workers in turn,
+ * and workers running out of files steal the ones still queued by
+ * the others.
+ *
+ * Output paths are given before starting, in the order of `paths`,
+ * so when several files would have the same markdown file, the ones
+ * after the first get a numeric suffix, whatever the number of jobs.
+ * So does a file which markdown file would be one of `paths`.
+ *
+ * A file failing to convert doesn't stop the batch, but makes it
+ * return an error.
+ */
+int
+batch_convert (char **paths, size_t count, const char *output_dir, size_t jobs)
+{
+  if (output_dir && make_output_dir (output_dir))
+    return 1;
+
+  if (jobs < 1)
+    jobs = 1;
+
+  if (jobs > count)
+    jobs = count ? count : 1;
+
+  batch_t batch = {
+    .paths = paths,
+    .outputs = xalloc ((count ? count : 1) * sizeof (char *)),
+    .count = count,
+    .workers = xalloc (jobs * sizeof (worker_t)),
+    .workers_count = jobs,
+  };
+
+  char *path = NULL;
+  size_t path_capacity = 0;
+  path_set_protect (&batch.claimed, paths, count);
+  for (size_t i = 0; i < count; i++)
+    {
+      output_path (&path, &path_capacity, paths[i], output_dir);
+      batch.outputs[i] = claim_output_path (&batch.claimed, path);
+    }
+
+  free (path);
+
+  size_t per_worker = (count + jobs - 1) / jobs;
+  for (size_t i = 0; i < jobs; i++)
+    {
+      worker_t *worker = &batch.workers[i];
+      worker->id = i;
+      worker->batch = &batch;
+      worker->ctx = w2m_ctx_new ();
+      sink_init (&worker->sink, -1, SINK_BUFFER_SIZE);
+      deque_init (&worker->deque, per_worker);
+    }
+
+  for (size_t job = 0; job < count; job++)
+    deque_push (&batch.workers[job % jobs].deque, job);
+
+  /*
+   * The main thread is the first worker. If a thread can't be
+   * started, its files are stolen by the other workers.
+   */
+  for (size_t i = 1; i < jobs; i++)
+    {
+      worker_t *worker = &batch.workers[i];
+      worker->started = pthread_create (&worker->thread, NULL, work, worker) == 0;
+      if (!worker->started)
+        fprintf (stderr, "batch.c : batch_convert() : can't start worker %zu.\n", i);
+    }
+
+  work (&batch.workers[0]);
+
+  // all workers must be done before releasing anything, deques are shared.
+  for (size_t i = 1; i < jobs; i++)
+    if (batch.workers[i].started)
+      pthread_join (batch.workers[i].thread, NULL);
+
+  size_t failures = 0;
+  for (size_t i = 0; i < jobs; i++)
+    {
+      worker_t *worker = &batch.workers[i];
+      failures += worker->failures;
+      w2m_ctx_free (worker->ctx);
+      sink_release (&worker->sink);
+      deque_release (&worker->deque);
+    }
+
+  free (batch.workers);
+  free (batch.outputs);
+  path_set_release (&batch.claimed);
+
+  if (failures)
+    fprintf (stderr, "batch.c : batch_convert() : %zu of %zu files failed.\n", failures, count);
+
+  return failures > 0;
+}
+
+/*
+ * Convert pages of the dump `filename` one after the other.
+ */
+static int
+convert_dump (const char *filename, const char *output_dir)
+{
+  xml_reader_t reader = {0};
+  xml_page_t page = {0};
+  worker_t worker = {0};
+  path_set_t claimed = {0};
+  char *path = NULL;
+  size_t path_capacity = 0;
+  size_t failures = 0;
+  size_t count = 0;
+
+  int err = xml_reader_open (&reader, filename);
+  if (err)
+    {
+      fprintf (stderr, "batch.c : convert_dump() : can't open dump %s\n", filename);
+      return err;
+    }
+
+  worker.ctx = w2m_ctx_new ();
+  sink_init (&worker.sink, output_dir ? -1 : STDOUT_FILENO, SINK_BUFFER_SIZE);
+  path_set_protect (&claimed, (char *[]) { (char *) filename }, 1);
+
+  while (true)
+    {
+      bool found = false;
+      err = xml_reader_next (&reader, &page, &found);
+      if (err)
+        {
+          fprintf (stderr, "batch.c : convert_dump() : error while reading page %zu of %s\n", count + 1, filename);
+          break;
+        }
+
+      if (!found)
+        break;
+
+      count++;
+      char *page_path = output_dir ? claim_page_path (&claimed, &path, &path_capacity, &page, output_dir) : NULL;
+      if (convert_page (&worker, &page, output_dir, page_path, &worker.sink))
+        {
+          fprintf (stderr, "batch.c : convert_dump() : can't convert page %s\n", page.title);
+          failures++;
+        }
+    }
+
+  if (failures)
+    fprintf (stderr, "batch.c : convert_dump() : %zu of %zu pages failed.\n", failures, count);
+
+  w2m_ctx_free (worker.ctx);
+  sink_release (&worker.sink);
+  path_set_release (&claimed);
+  free (path);
+  xml_page_release (&page);
+  xml_reader_close (&reader);
+
+  return err || failures > 0;
+}
+
+/*
+ * Pipeline worker thread: convert pages until the reader is done and
+ * all pages are taken.
+ */
+static void *
+convert_pages (void *data)
+{
+  worker_t *worker = data;
+  pipeline_t *pipeline = worker->pipeline;
+
+  pthread_mutex_lock (&pipeline->lock);
+  while (true)
+    {
+      while (pipeline->claimed_count == pipeline->read_count && !pipeline->reading_done)
+        pthread_cond_wait (&pipeline->page_read, &pipeline->lock);
+
+      if (pipeline->claimed_count == pipeline->read_count)
+        break;
+
+      slot_t *slot = &pipeline->slots[pipeline->claimed_count++ % pipeline->slots_count];
+      pthread_mutex_unlock (&pipeline->lock);
+
+      bool failed = convert_page (worker, &slot->page, pipeline->output_dir, slot->path, &slot->output) != 0;
+      if (failed)
+        fprintf (stderr, "batch.c : convert_pages() : can't convert page %s\n", slot->page.title);
+
+      pthread_mutex_lock (&pipeline->lock);
+      slot->failed = failed;
+      slot->converted = true;
+      pthread_cond_signal (&pipeline->page_converted);
+    }
+
+  pthread_mutex_unlock (&pipeline->lock);
+
+  return NULL;
+}
+
+/*
+ * Pipeline writer thread: output converted pages in the order of
+ * the dump, and give their slots back to the reader.
+ */
+static void *
+write_pages (void *data)
+{
+  pipeline_t *pipeline = data;
+
+  pthread_mutex_lock (&pipeline->lock);
+  while (true)
+    {
+      slot_t *slot = &pipeline->slots[pipeline->written_count % pipeline->slots_count];
+      bool pending = pipeline->written_count < pipeline->read_count;
+
+      if (!pending && pipeline->reading_done)
+        break;
+
+      if (!pending || !slot->converted)
+        {
+          pthread_cond_wait (&pipeline->page_converted, &pipeline->lock);
+          continue;
+        }
+
+      pthread_mutex_unlock (&pipeline->lock);
+
+      bool failed = slot->failed;
+      if (!pipeline->output_dir && sink_write_to (&slot->output, STDOUT_FILENO) != 0)
+        {
+          fprintf (stderr, "batch.c : write_pages() : can't write page %s\n", slot->page.title);
+          failed = true;
+        }
+
+      sink_attach (&slot->output, -1);
+
+      pthread_mutex_lock (&pipeline->lock);
+      slot->converted = false;
+      pipeline->failures += failed;
+      pipeline->written_count++;
+      pthread_cond_signal (&pipeline->slot_freed);
+    }
+
+  pthread_mutex_unlock (&pipeline->lock);
+
+  return NULL;
+}
+
+/*
+ * Read pages of `reader` into the pipeline, until the end of the dump.
+ *
+ * Files of pages are claimed here, in the order of the dump, so pages
+ * with the same file get the same names whatever the number of jobs.
+ */
+static int
+read_pages (pipeline_t *pipeline, xml_reader_t *reader)
+{
+  int err = 0;
+
+  pthread_mutex_lock (&pipeline->lock);
+  while (true)
+    {
+      while (pipeline->read_count - pipeline->written_count == pipeline->slots_count)
+        pthread_cond_wait (&pipeline->slot_freed, &pipeline->lock);
+
+      slot_t *slot = &pipeline->slots[pipeline->read_count % pipeline->slots_count];
+      pthread_mutex_unlock (&pipeline->lock);
+
+      bool found = false;
+      err = xml_reader_next (reader, &slot->page, &found);
+      if (err)
+        fprintf (stderr, "batch.c : read_pages() : error while reading page %zu.\n", pipeline->read_count + 1);
+
+      if (found && pipeline->output_dir)
+        slot->path = claim_page_path (&pipeline->claimed, &pipeline->path, &pipeline->path_capacity, &slot->page, pipeline->output_dir);
+
+      pthread_mutex_lock (&pipeline->lock);
+      if (err || !found)
+        break;
+
+      pipeline->read_count++;
+      pthread_cond_signal (&pipeline->page_read);
+    }
+
+  pipeline->reading_done = true;
+  pthread_cond_broadcast (&pipeline->page_read);
+  pthread_cond_broadcast (&pipeline->page_converted);
+  pthread_mutex_unlock (&pipeline->lock);
+
+  return err;
+}
+
+/*
+ * Convert pages of the dump `filename` on `jobs` worker threads, while
+ * the main thread reads the dump and an other thread writes the result.
+ *
+ * Falls back to `convert_dump()` if threads can't be started.
+ */
+static int
+convert_dump_in_parallel (const char *filename, const char *output_dir, size_t jobs)
+{
+  xml_reader_t reader = {0};
+  pthread_t writer;
+  pipeline_t pipeline = {
+    .slots_count = jobs * BATCH_SLOTS_PER_JOB,
+    .output_dir = output_dir,
+  };
+
+  int err = xml_reader_open (&reader, filename);
+  if (err)
+    {
+      fprintf (stderr, "batch.c : convert_dump_in_parallel() : can't open dump %s\n", filename);
+      return err;
+    }
+
+  path_set_protect (&pipeline.claimed, (char *[]) { (char *) filename }, 1);
+  pthread_mutex_init (&pipeline.lock, NULL);
+  pthread_cond_init (&pipeline.slot_freed, NULL);
+  pthread_cond_init (&pipeline.page_read, NULL);
+  pthread_cond_init (&pipeline.page_converted, NULL);
+  pipeline.slots = xalloc (pipeline.slots_count * sizeof *pipeline.slots);
+  for (size_t i = 0; i < pipeline.slots_count; i++)
+    sink_init (&pipeline.slots[i].output, -1, SINK_BUFFER_SIZE);
+
+  worker_t *workers = xalloc (jobs * sizeof *workers);
+  size_t started = 0;
+  bool writer_started = pthread_create (&writer, NULL, write_pages, &pipeline) == 0;
+
+  for (size_t i = 0; writer_started && i < jobs; i++)
+    {
+      worker_t *worker = &workers[i];
+      worker->id = i;
+      worker->pipeline = &pipeline;
+      worker->ctx = w2m_ctx_new ();
+      sink_init (&worker->sink, -1, SINK_BUFFER_SIZE);
+      worker->started = pthread_create (&worker->thread, NULL, convert_pages, worker) == 0;
+      started += worker->started;
+    }
+
+  if (started > 0)
+    err = read_pages (&pipeline, &reader);
+  else
+    {
+      // nothing read, this only stops the writer.
+      pthread_mutex_lock (&pipeline.lock);
+      pipeline.reading_done = true;
+      pthread_cond_broadcast (&pipeline.page_converted);
+      pthread_mutex_unlock (&pipeline.lock);
+    }
+
+  for (size_t i = 0; i < jobs; i++)
+    {
+      worker_t *worker = &workers[i];
+      if (worker->started)
+        pthread_join (worker->thread, NULL);
+
+      w2m_ctx_free (worker->ctx);
+      if (worker->sink.buffer)
+        sink_release (&worker->sink);
+    }
+
+  if (writer_started)
+    pthread_join (writer, NULL);
+
+  for (size_t i = 0; i < pipeline.slots_count; i++)
+    {
+      xml_page_release (&pipeline.slots[i].page);
+      sink_release (&pipeline.slots[i].output);
+    }
+
+  free (pipeline.slots);
+  free (workers);
+  path_set_release (&pipeline.claimed);
+  free (pipeline.path);
+  pthread_cond_destroy (&pipeline.page_converted);
+  pthread_cond_destroy (&pipeline.page_read);
+  pthread_cond_destroy (&pipeline.slot_freed);
+  pthread_mutex_destroy (&pipeline.lock);
+  xml_reader_close (&reader);
+
+  if (started == 0)
+    {
+      fprintf (stderr, "batch.c : convert_dump_in_parallel() : can't start threads, converting sequentially.\n");
+      return convert_dump (filename, output_dir);
+    }
+
+  if (pipeline.failures)
+    fprintf (stderr, "batch.c : convert_dump_in_parallel() : %zu of %zu pages failed.\n", pipeline.failures, pipeline.written_count);
+
+  return err || pipeline.failures > 0;
+}
+
+/*
+ * Convert each page of the MediaWiki XML dump `filename`, to a file
+ * named after its title in `output_dir`, or all of them to stdout
+ * when `output_dir` is NULL.
+ *
+ * The dump is streamed, pages are never written to disk as wikitext.
+ * With more than one job, pages are converted in parallel, and still
+ * written in the order of the dump.
+ */
+int
+batch_convert_dump (const char *filename, const char *output_dir, size_t jobs)
+{
+  if (output_dir && make_output_dir (output_dir))
+    return 1;
+
+  if (jobs <= 1)
+    return convert_dump (filename, output_dir);
+
+  return convert_dump_in_parallel (filename, output_dir, jobs);
+}
@@ -0,0 +1,28 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#define BATCH_MAX_JOBS 1024
+
+/*
+ * Pages a dump conversion can hold in memory per worker thread, being
+ * read, converted or waiting to be written.
+ */
+#define BATCH_SLOTS_PER_JOB 4
+
+/*
+ * Files to convert in batch mode.
+ *
+ * When read from a list, `paths` point into `content`.
+ */
+typedef struct {
+  char **paths;
+  size_t count;
+  char *content;
+} file_list_t;
+
+int batch_read_list (file_list_t *list, FILE *file);
+void batch_free_list (file_list_t *list);
+int batch_convert (char **paths, size_t count, const char *output_dir, size_t jobs);
+int batch_convert_dump (const char *filename, const char *output_dir, size_t jobs);
+
+#endif
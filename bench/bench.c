@@ -0,0 +1,403 @@
+/*
+ * Throughput benchmark of the parse and dump phases.
+ *
+ * Generates synthetic documents for several kinds of pages (prose, tables,
+ * lists, templates, links) at sizes from 1KB up to `max-size`, converts
+ * each of them in memory, and prints results as JSON on stdout.
+ *
+ * usage: bench/bench [max-size-in-bytes]
+ *
+ * All int returning functions returns non-zero in case of error, unless
+ * explicitly mentioned.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "dumper.h"
+#include "parser.h"
+#include "sink.h"
+#include "utils.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define BENCH_DEFAULT_MAX_SIZE 50000000
+
+/*
+ * Each case is run until it took at least that long (in seconds),
+ * the fastest run being reported.
+ */
+#define BENCH_MIN_TIME 0.3
+#define BENCH_MAX_RUNS 50
+
+typedef struct {
+  char *content;
+  size_t len;
+  size_t capacity;
+  uint64_t seed;
+} document_t;
+
+typedef void (*generator_t) (document_t *doc);
+
+typedef struct {
+  const char *name;
+  generator_t generate;
+} profile_t;
+
+typedef struct {
+  double parse_seconds;
+  double dump_seconds;
+  size_t nodes;
+  size_t output_len;
+  long peak_rss_kb;
+} result_t;
+
+static const char *const words[] = {
+  "the", "engine", "was", "designed", "by", "a", "mathematician", "who", "wrote",
+  "notes", "about", "its", "possible", "uses", "beyond", "calculation", "and",
+  "music", "of", "any", "degree", "complexity", "in", "London", "during", "century",
+};
+
+static const size_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000, 50000000 };
+
+/*
+ * Pseudo random number, reproducible across runs (xorshift64).
+ */
+static uint64_t
+next_random (document_t *doc)
+{
+  doc->seed ^= doc->seed << 13;
+  doc->seed ^= doc->seed >> 7;
+  doc->seed ^= doc->seed << 17;
+
+  return doc->seed;
+}
+
+/*
+ * Add a printf formatted string to the document.
+ */
+__attribute__ ((format (printf, 2, 3)))
+static void
+add (document_t *doc, const char *format, ...)
+{
+  va_list args;
+
+  while (true)
+    {
+      size_t available = doc->capacity - doc->len;
+      va_start (args, format);
+      int len = vsnprintf (doc->content + doc->len, available, format, args);
+      va_end (args);
+
+      if ((size_t) len < available)
+        {
+          doc->len += len;
+          return;
+        }
+
+      doc->capacity = doc->capacity ? doc->capacity * 2 : BUFSIZ;
+      doc->content = xrealloc (doc->content, doc->capacity);
+    }
+}
+
+static const char *
+word (document_t *doc)
+{
+  return words[next_random (doc) % (sizeof words / sizeof words[0])];
+}
+
+/*
+ * Add a sentence of plain words, with a bit of emphasis.
+ */
+static void
+add_sentence (document_t *doc)
+{
+  size_t count = 6 + next_random (doc) % 10;
+  for (size_t i = 0; i < count; i++)
+    {
+      uint64_t style = next_random (doc) % 16;
+      const char *separator = i ? " " : "";
+
+      if (style == 0)
+        add (doc, "%s'''%s'''", separator, word (doc));
+      else if (style == 1)
+        add (doc, "%s''%s''", separator, word (doc));
+      else
+        add (doc, "%s%s", separator, word (doc));
+    }
+
+  add (doc, ". ");
+}
+
+static void
+generate_prose (document_t *doc)
+{
+  if (next_random (doc) % 6 == 0)
+    add (doc, "== %s %s ==\n", word (doc), word (doc));
+
+  size_t count = 3 + next_random (doc) % 5;
+  for (size_t i = 0; i < count; i++)
+    add_sentence (doc);
+
+  add (doc, "\n\n");
+}
+
+/*
+ * Tables attributes are not supported by the parser, so there is none.
+ */
+static void
+generate_tables (document_t *doc)
+{
+  size_t columns = 2 + next_random (doc) % 4;
+  size_t rows = 3 + next_random (doc) % 10;
+
+  add (doc, "{|\n|+ %s %s\n|-\n", word (doc), word (doc));
+  for (size_t column = 0; column < columns; column++)
+    add (doc, "%s %s", column ? " !!" : "!", word (doc));
+
+  add (doc, "\n");
+  for (size_t row = 0; row < rows; row++)
+    {
+      add (doc, "|-\n");
+      for (size_t column = 0; column < columns; column++)
+        add (doc, "%s %s %zu", column ? " ||" : "|", word (doc), (size_t) (next_random (doc) % 2000));
+
+      add (doc, "\n");
+    }
+
+  add (doc, "|}\n\n");
+}
+
+static void
+generate_lists (document_t *doc)
+{
+  static const char *const markers[] = { "*", "#", "**", "##", ";", ":" };
+
+  size_t count = 4 + next_random (doc) % 12;
+  size_t kind = next_random (doc) % 3;
+  for (size_t i = 0; i < count; i++)
+    {
+      const char *marker = kind == 2 ? markers[4 + i % 2] : markers[kind + (next_random (doc) % 3 == 0 ? 2 : 0)];
+      add (doc, "%s %s %s %s\n", marker, word (doc), word (doc), word (doc));
+    }
+
+  add (doc, "\n");
+}
+
+static void
+generate_templates (document_t *doc)
+{
+  add (doc, "{{Infobox %s\n", word (doc));
+
+  size_t count = 3 + next_random (doc) % 8;
+  for (size_t i = 0; i < count; i++)
+    add (doc, "| %s = %s %s\n", word (doc), word (doc), word (doc));
+
+  add (doc, "}}\n%s {{%s|%s}} %s {{%s}}.\n\n", word (doc), word (doc), word (doc), word (doc), word (doc));
+}
+
+static void
+generate_links (document_t *doc)
+{
+  size_t count = 5 + next_random (doc) % 10;
+  for (size_t i = 0; i < count; i++)
+    {
+      uint64_t kind = next_random (doc) % 5;
+
+      if (kind == 0)
+        add (doc, "[[%s %s|%s]] ", word (doc), word (doc), word (doc));
+      else if (kind == 1)
+        add (doc, "[https://example.org/%s/%s %s] ", word (doc), word (doc), word (doc));
+      else if (kind == 2)
+        add (doc, "[[File:%s_%s.jpg|thumb|%s [[%s]]]] ", word (doc), word (doc), word (doc), word (doc));
+      else
+        add (doc, "[[%s]] ", word (doc));
+    }
+
+  add (doc, "\n\n");
+}
+
+static const profile_t profiles[] = {
+  { "prose", generate_prose },
+  { "tables", generate_tables },
+  { "lists", generate_lists },
+  { "templates", generate_templates },
+  { "links", generate_links },
+};
+
+/*
+ * Seconds elapsed since an arbitrary point.
+ */
+static double
+now (void)
+{
+  struct timespec time;
+  clock_gettime (CLOCK_MONOTONIC, &time);
+
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*
+ * Reset the peak resident set size of the process, so it can be measured
+ * for each case. Only supported on Linux, and ignored elsewhere.
+ */
+static void
+reset_peak_rss (void)
+{
+  FILE *file = fopen ("/proc/self/clear_refs", "w");
+  if (!file)
+    return;
+
+  fputs ("5", file);
+  fclose (file);
+}
+
+/*
+ * Peak resident set size in KB, since the last `reset_peak_rss()` when
+ * supported, or since the start of the process otherwise.
+ */
+static long
+peak_rss (void)
+{
+  char line[256];
+  long peak = -1;
+
+  FILE *file = fopen ("/proc/self/status", "r");
+  if (file)
+    {
+      while (fgets (line, sizeof line, file))
+        if (sscanf (line, "VmHWM: %ld kB", &peak) == 1)
+          break;
+
+      fclose (file);
+    }
+
+  if (peak < 0)
+    {
+      struct rusage usage;
+      getrusage (RUSAGE_SELF, &usage);
+      peak = usage.ru_maxrss;
+    }
+
+  return peak;
+}
+
+/*
+ * Parse and dump `doc`, keeping the fastest time of each phase.
+ */
+static int
+run (document_t *doc, result_t *result)
+{
+  arena_t arena = {0};
+  sink_t sink = {0};
+  double total = 0;
+  int err = 0;
+
+  sink_init (&sink, -1, SINK_BUFFER_SIZE);
+  reset_peak_rss ();
+
+  for (size_t runs = 0; runs < BENCH_MAX_RUNS && (runs == 0 || total < BENCH_MIN_TIME); runs++)
+    {
+      reader_t reader;
+      reader_open_memory (&reader, doc->content, doc->len);
+      arena_reset (&arena);
+
+      double start = now ();
+      tree_t tree;
+      tree_init (&tree, &arena);
+      err = parse (&reader, &tree);
+      double parsed = now ();
+      if (err)
+        {
+          fprintf (stderr, "bench.c : run() : can't parse document.\n");
+          break;
+        }
+
+      sink_attach (&sink, -1);
+      dumping_params_t params = {
+        .tree = &tree,
+        .node = tree_node (&tree, TREE_ROOT),
+        .sink = &sink,
+      };
+
+      err = dump (&params);
+      double dumped = now ();
+      if (err)
+        {
+          fprintf (stderr, "bench.c : run() : can't dump document.\n");
+          break;
+        }
+
+      if (runs == 0 || parsed - start < result->parse_seconds)
+        result->parse_seconds = parsed - start;
+
+      if (runs == 0 || dumped - parsed < result->dump_seconds)
+        result->dump_seconds = dumped - parsed;
+
+      result->nodes = tree.len - TREE_ROOT;
+      result->output_len = sink.writing_ptr - sink.buffer;
+      total += dumped - start;
+      reader_close (&reader);
+    }
+
+  result->peak_rss_kb = peak_rss ();
+  arena_release (&arena);
+  sink_release (&sink);
+
+  return err;
+}
+
+static void
+print_phase (const char *name, double seconds, size_t bytes, size_t nodes)
+{
+  printf ("\"%s\": {\"seconds\": %.6f, \"mb_per_s\": %.2f, \"nodes_per_s\": %.0f}",
+          name, seconds, bytes / seconds / 1e6, nodes / seconds);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t max_size = argc > 1 ? strtoull (argv[1], NULL, 10) : BENCH_DEFAULT_MAX_SIZE;
+  bool first = true;
+  int err = 0;
+
+  printf ("{\n  \"version\": \"%s\",\n  \"results\": [", BENCH_VERSION);
+
+  for (size_t i = 0; i < sizeof profiles / sizeof profiles[0] && !err; i++)
+    {
+      for (size_t j = 0; j < sizeof sizes / sizeof sizes[0] && sizes[j] <= max_size && !err; j++)
+        {
+          document_t doc = { .seed = 0x9e3779b97f4a7c15 };
+          while (doc.len < sizes[j])
+            profiles[i].generate (&doc);
+
+          result_t result = {0};
+          err = run (&doc, &result);
+          if (!err)
+            {
+              printf ("%s\n    {\"profile\": \"%s\", \"bytes\": %zu, \"nodes\": %zu, \"output_bytes\": %zu, ",
+                      first ? "" : ",", profiles[i].name, doc.len, result.nodes, result.output_len);
+              print_phase ("parse", result.parse_seconds, doc.len, result.nodes);
+              printf (", ");
+              print_phase ("dump", result.dump_seconds, doc.len, result.nodes);
+              printf (", \"peak_rss_kb\": %ld}", result.peak_rss_kb);
+              fflush (stdout);
+              first = false;
+            }
+
+          free (doc.content);
+        }
+    }
+
+  printf ("\n  ]\n}\n");
+
+  return err;
+}
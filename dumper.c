@@ -9,678 +9,515 @@
 #include "utils.h"
 
 #define MAX_LINE_LENGTH 10000
-#define MAX_LINK_LENGTH 5000
 
-#define SUPPORTED_IMAGE_FORMATS 7
-const char *image_formats[SUPPORTED_IMAGE_FORMATS] = { ".jpg", ".jpeg", ".png", ".gif", ".webp", ".svg", ".tiff" };
+/*
+ * Hash of an extension from its first and last characters (lower case)
+ * and its length. It's perfect for the extensions in `image_extensions`,
+ * a collision would be caught by -Woverride-init.
+ */
+#define IMAGE_EXTENSION_HASH(first, last, len) (((unsigned char) (first) + (unsigned char) (last) + (len)) % 16)
 
+/*
+ * Indexed by IMAGE_EXTENSION_HASH().
+ */
+static const char *const image_extensions[16] = {
+  [IMAGE_EXTENSION_HASH ('j', 'g', 3)] = "jpg",
+  [IMAGE_EXTENSION_HASH ('j', 'g', 4)] = "jpeg",
+  [IMAGE_EXTENSION_HASH ('p', 'g', 3)] = "png",
+  [IMAGE_EXTENSION_HASH ('g', 'f', 3)] = "gif",
+  [IMAGE_EXTENSION_HASH ('w', 'p', 4)] = "webp",
+  [IMAGE_EXTENSION_HASH ('s', 'g', 3)] = "svg",
+  [IMAGE_EXTENSION_HASH ('t', 'f', 4)] = "tiff",
+};
+
+/*
+ * Markdown doesn't accept parenthesis in urls, so we need to escape them.
+ */
+static const char *const url_escapes[256] = {
+  ['('] = "%28",
+  [')'] = "%29",
+};
+
+/*
+ * Initial depth of the stack used to walk the tree, it grows as needed.
+ */
+#define DUMPING_STACK_SIZE 64
+
+/*
+ * A node type is dumped by an `enter` callback, called before its
+ * children are dumped, and a `leave` callback, called after. Both are
+ * optional. When `dumps_child` is set, only children it accepts are
+ * dumped. A dumper without any of them is reported as missing, only
+ * the root doesn't need one.
+ */
 typedef int (dumping_node_t) (dumping_params_t *params);
+typedef bool (dumping_filter_t) (node_t *child);
 typedef struct {
   size_t type; // only used to make `dumpers` more readable.
-  dumping_node_t *handler;
+  dumping_node_t *enter;
+  dumping_node_t *leave;
+  dumping_filter_t *dumps_child;
 } dumper_def_t;
 
-static bool 
-contains_link (node_t *node)
+/*
+ * A node being dumped, in the stack used to walk the tree.
+ */
+typedef struct {
+  dumping_params_t params;
+  const dumper_def_t *dumper;
+  node_t *next_child; // NULL once all children have been dumped.
+} dumping_frame_t;
+
+/*
+ * Check if `url` ends with the extension of an image format. Only
+ * the end is looked at, so `x.png.png` is an image, even though the
+ * extension is found earlier in it.
+ */
+static bool
+is_image (const char *url, size_t len)
 {
-  if (!node->is_block_level && (node->type == NODE_INTERNAL_LINK || node->type == NODE_EXTERNAL_LINK))
-    return true;
+  size_t extension_len = 0;
+  while (extension_len < len && extension_len <= 4 && url[len - 1 - extension_len] != '.')
+    extension_len++;
+
+  if (extension_len < 3 || extension_len > 4 || extension_len == len)
+    return false;
 
-  if (node->children_len == 0)
+  const char *extension = url + len - extension_len;
+  const char *candidate = image_extensions[IMAGE_EXTENSION_HASH (tolower ((unsigned char) extension[0]), tolower ((unsigned char) extension[extension_len - 1]), extension_len)];
+  if (!candidate || strlen (candidate) != extension_len)
     return false;
 
-  for (size_t i = 0; i < node->children_len; i++)
-    if (contains_link (node->children[i]))
-      return true;
+  for (size_t i = 0; i < extension_len; i++)
+    if (tolower ((unsigned char) extension[i]) != candidate[i])
+      return false;
 
-  return false;
+  return true;
 }
 
 /*
- * Convert a mediawiki media link to markdown.
+ * Add `url` escaped for markdown. Space must have been reserved for
+ * three times its length.
+ */
+static void
+append_url (sink_t *sink, const char *url, size_t len)
+{
+  const char *span = url;
+  for (const char *ptr = url; ptr < url + len; ptr++)
+    {
+      const char *escape = url_escapes[(unsigned char) ptr[0]];
+      if (!escape)
+        continue;
+
+      sink_append (sink, span, ptr - span);
+      sink_append (sink, escape, 3);
+      span = ptr + 1;
+    }
+
+  sink_append (sink, span, url + len - span);
+}
+
+/*
+ * Start a link: its children are dumped right in the sink, so they can
+ * be reworked into the link markup when leaving it. The sink mark is
+ * set (unless an enclosing link did it already) so they're not drained
+ * in the meantime.
  *
- * More parsing is done here to match the various components
- * of the links.
+ * The position of the content is kept from the mark, since the buffer
+ * may move.
  */
 static int
-dump_media (dumping_params_t *params)
+link_enter (dumping_params_t *params)
 {
-  char link_def[MAX_LINK_LENGTH] = {0};
-  char *link_ptr = link_def;
-  size_t link_max_len = MAX_LINK_LENGTH;
+  sink_t *sink = params->sink;
+  params->had_mark = sink->mark != NULL;
+  if (!sink->mark)
+    sink->mark = sink->writing_ptr;
+
+  params->link_offset = sink->writing_ptr - sink->mark;
 
-  // protect against empty nodes
-  if (params->node->children_len == 1 && is_empty_text_node (params->node->children[0]))
+  return 0;
+}
+
+/*
+ * Drop link content at `content` from its first NUL byte, content
+ * being handled as a string. Returns the remaining length.
+ */
+static size_t
+trim_link_content (sink_t *sink, char *content)
+{
+  size_t len = strnlen (content, sink->writing_ptr - content);
+  sink->max_len += sink->writing_ptr - (content + len);
+  sink->writing_ptr = content + len;
+
+  return len;
+}
+
+/*
+ * Replace link content at `content` with the markup written after it
+ * at `markup`, and release the mark if it was set for this link.
+ */
+static void
+replace_link_content (sink_t *sink, char *content, char *markup, bool had_mark)
+{
+  size_t markup_len = sink->writing_ptr - markup;
+  memmove (content, markup, markup_len);
+  sink->max_len += markup - content;
+  sink->writing_ptr = content + markup_len;
+  sink->writing_ptr[0] = 0;
+
+  if (!had_mark)
+    sink->mark = NULL;
+}
+
+/*
+ * Media without content are skipped.
+ */
+static bool
+is_empty_media (const tree_t *tree, node_t *node)
+{
+  return node->first_child && node->first_child == node->last_child && is_empty_text_node (tree_node (tree, node->first_child));
+}
+
+/*
+ * Start a mediawiki media link.
+ */
+static int
+media_enter (dumping_params_t *params)
+{
+  if (is_empty_media (params->tree, params->node))
     return 0;
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = &link_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = &link_max_len,
-      };
+  return link_enter (params);
+}
 
-      int err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : dump_media() : error while processing link content.\n");
-          return 1;
-        }
-    }
+/*
+ * Convert a mediawiki media link to markdown.
+ *
+ * Content is `url|option|...|caption`, images are embedded, other
+ * media are linked.
+ */
+static int
+media_leave (dumping_params_t *params)
+{
+  sink_t *sink = params->sink;
 
-  if (strlen (link_def) == 0)
+  if (is_empty_media (params->tree, params->node))
+    return 0;
+
+  char *content = sink->mark + params->link_offset;
+  size_t len = trim_link_content (sink, content);
+  if (len == 0)
     {
-      fprintf (stderr, "dumper.c : dump_media() : warning : empty link detected.\n");
+      fprintf (stderr, "dumper.c : media_leave() : warning : empty link detected.\n");
+      if (!params->had_mark)
+        sink->mark = NULL;
+
       return 1;
     }
 
-  char *first_pipe = strstr (link_def, "|");
-  char *last_pipe = first_pipe;
-  if (last_pipe)
+  const char *first_pipe = memchr (content, '|', len);
+  size_t url_len = first_pipe ? (size_t) (first_pipe - content) : len;
+  size_t caption_offset = len;
+  while (first_pipe && content[caption_offset - 1] != '|')
+    caption_offset--;
+
+  size_t caption_len = len - caption_offset;
+  if (!caption_len)
     {
-      last_pipe++;
-      while (true)
-        {
-          char *next = strstr (last_pipe, "|");
-          if (next)
-            last_pipe = ++next;
-          else
-            break;
-        }
+      caption_offset = 0;
+      caption_len = url_len;
     }
-  char url[MAX_LINK_LENGTH] = {0};
-  snprintf (url, (first_pipe ? (size_t) (first_pipe - link_def) : strlen (link_def)) + 1, "%s", link_def);
-
-  if (!last_pipe || !strlen (last_pipe))
-    last_pipe = url;
-
-  bool is_image = false;
-  char *lower_url = strdup (url);
 
-  for (size_t i = 0; i < strlen (lower_url); i++)
-    lower_url[i] = tolower (lower_url[i]);
-
-  for (size_t i = 0; i < SUPPORTED_IMAGE_FORMATS; i++)
+  bool image = is_image (content, url_len);
+  int err = sink_reserve (sink, 2 * url_len + caption_len + 16);
+  if (err)
     {
-      const char *format = image_formats[i];
-      char *match = strstr (lower_url, format);
-      if (match && strlen (match) == strlen (format))
-        {
-          is_image = true;
-          break;
-        }
-    }
+      fprintf (stderr, "dumper.c : media_leave() : can't reserve output space.\n");
+      if (!params->had_mark)
+        sink->mark = NULL;
 
-  free (lower_url);
+      return err;
+    }
 
-  char markup[MAX_LINK_LENGTH] = {0};
+  content = sink->mark + params->link_offset;
+  char *markup = sink->writing_ptr;
 
-  if (contains_link (params->node))
+  if (image && params->node->flags & NODE_CONTAINS_LINK)
     {
-      if (is_image)
-        {
-          if (snprintf (markup, MAX_LINK_LENGTH - 1, "![%s](%s)\n\n**%s**\n\n", url, url, last_pipe) >= MAX_LINK_LENGTH - 1)
-            fprintf (stderr, "dumper.c : dump_media() : warning : link too long has been truncated : %s, %s\n", last_pipe, url);
-        }
-      else
-        {
-          if (snprintf (markup, MAX_LINK_LENGTH - 1, "[%s](%s)", last_pipe, url) >= MAX_LINK_LENGTH - 1)
-            fprintf (stderr, "dumper.c : dump_media() : warning : link too long has been truncated : %s, %s\n", last_pipe, url);
-        }
+      SINK_APPEND_LITERAL (sink, "![");
+      sink_append (sink, content, url_len);
+      SINK_APPEND_LITERAL (sink, "](");
+      sink_append (sink, content, url_len);
+      SINK_APPEND_LITERAL (sink, ")\n\n**");
+      sink_append (sink, content + caption_offset, caption_len);
+      SINK_APPEND_LITERAL (sink, "**\n\n");
     }
   else
     {
-      if (is_image)
-        {
-          if (snprintf (markup, MAX_LINK_LENGTH - 1, "![%s](%s)", last_pipe, url) >= MAX_LINK_LENGTH - 1)
-            fprintf (stderr, "dumper.c : dump_media() : warning : link too long has been truncated : %s, %s\n", last_pipe, url);
-        }
+      if (image)
+        SINK_APPEND_LITERAL (sink, "![");
       else
-        {
-          if (snprintf (markup, MAX_LINK_LENGTH - 1, "[%s](%s)", last_pipe, url) >= MAX_LINK_LENGTH - 1)
-            fprintf (stderr, "dumper.c : dump_media() : warning : link too long has been truncated : %s, %s\n", last_pipe, url);
-        }
+        SINK_APPEND_LITERAL (sink, "[");
+
+      sink_append (sink, content + caption_offset, caption_len);
+      SINK_APPEND_LITERAL (sink, "](");
+      sink_append (sink, content, url_len);
+      SINK_APPEND_LITERAL (sink, ")");
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "%s", markup);
-  *params->writing_ptr += strlen (markup);
-  *params->max_len -= strlen (markup);
+  replace_link_content (sink, content, markup, params->had_mark);
 
   return 0;
 }
 
 /*
- * Markdown doesn't accept parenthesis in urls, so we need to escape them.
+ * Starts markdown for NODE_BLOCKLEVEL_TEMPLATE.
  */
-static void
-escape_url_for_markdown (const char url[MAX_LINK_LENGTH], char escaped_url[MAX_LINK_LENGTH])
+static int
+template_block_enter (dumping_params_t *params)
 {
-  char *read_ptr = (char *) url;
-  char *write_ptr = escaped_url;
-  size_t len = strlen (url);
-
-  for (size_t i = 0; i < len; i++)
-    {
-      size_t written = write_ptr - escaped_url;
-      if (read_ptr[0] == '(' && written + 4 < MAX_LINK_LENGTH - 1)
-        {
-          snprintf (write_ptr, 4, "%%28");
-          write_ptr += 3;
-        }
-      else if (read_ptr[0] == ')' && written + 4 < MAX_LINK_LENGTH - 1)
-        {
-          snprintf (write_ptr, 4, "%%29");
-          write_ptr += 3;
-        }
-      else if (written + 2 < MAX_LINK_LENGTH - 1)
-        {
-          write_ptr[0] = read_ptr[0];
-          write_ptr++;
-        }
+  SINK_APPEND_LITERAL (params->sink, "<pre>{{");
 
-      read_ptr++;
-    }
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_BLOCKLEVEL_TEMPLATE.
+ * Ends markdown for NODE_BLOCKLEVEL_TEMPLATE.
  */
 static int
-template_block_dumper (dumping_params_t *params)
+template_block_leave (dumping_params_t *params)
 {
-  int err = 0;
-
-  snprintf (*params->writing_ptr, *params->max_len, "<pre>{{");
-  *params->writing_ptr += 7;
-  *params->max_len -= 7;
+  SINK_APPEND_LITERAL (params->sink, "}}<pre>\n\n");
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : template_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "}}<pre>\n\n");
-  *params->writing_ptr += 9;
-  *params->max_len -= 9;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_BULLET_LIST.
+ * Ends markdown for NODE_BULLET_LIST, NODE_DEFINITION_LIST,
+ * NODE_NUMBERED_LIST and their items.
  */
 static int
-bullet_list_block_dumper (dumping_params_t *params)
+list_block_leave (dumping_params_t *params)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+  SINK_APPEND_LITERAL (params->sink, "\n");
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : bullet_list_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_BULLET_LIST_ITEM.
+ * Starts markdown for NODE_BULLET_LIST_ITEM and NODE_NUMBERED_LIST_ITEM,
+ * `marker` being indented by the item level.
  */
 static int
-bullet_list_item_block_dumper (dumping_params_t *params)
+list_item_enter (dumping_params_t *params, const char *marker)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->subtype - 1; i++)
+  int err = sink_reserve (params->sink, params->node->subtype * 2);
+  if (err)
     {
-      snprintf (*params->writing_ptr, *params->max_len, "  ");
-      *params->writing_ptr += 2;
-      *params->max_len -= 2;
+      fprintf (stderr, "dumper.c : list_item_enter() : can't reserve output space.\n");
+      return err;
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "*");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
+  for (size_t i = 1; i < params->node->subtype; i++)
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : bullet_list_item_block_dumper() : can't dump child.\n");
-          return err;
-        }
+      SINK_APPEND_LITERAL (params->sink, "  ");
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
+  sink_append (params->sink, marker, 1);
 
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_DEFINITION_LIST.
+ * Starts markdown for NODE_BULLET_LIST_ITEM.
  */
 static int
-definition_list_block_dumper (dumping_params_t *params)
+bullet_list_item_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : definition_list_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  *params->writing_ptr += 1;
-  *params->max_len -= 1;
-
-  return err;
+  return list_item_enter (params, "*");
 }
 
 /*
- * Generates markdown for NODE_DEFINITION_LIST_TERM.
+ * Starts markdown for NODE_DEFINITION_LIST_TERM.
  */
 static int
-definition_list_term_block_dumper (dumping_params_t *params)
+definition_list_term_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  if (*params->writing_ptr - params->start_of_buffer >= 2)
-    if ((*params->writing_ptr - 1)[0] == '\n' && (*params->writing_ptr - 2)[0] != '\n')
+  char *writing_ptr = params->sink->writing_ptr;
+  if (writing_ptr - params->sink->buffer >= 2)
+    if (writing_ptr[-1] == '\n' && writing_ptr[-2] != '\n')
       {
-        snprintf (*params->writing_ptr, *params->max_len, "\n");
-        *params->writing_ptr += 1;
-        *params->max_len -= 1;
+        SINK_APPEND_LITERAL (params->sink, "\n");
       }
 
-  snprintf (*params->writing_ptr, *params->max_len, "**");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
+  SINK_APPEND_LITERAL (params->sink, "**");
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : definition_list_term_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "**\n\n");
-  *params->writing_ptr += 4;
-  *params->max_len -= 4;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_DEFINITION_LIST_DEFINITION.
+ * Ends markdown for NODE_DEFINITION_LIST_TERM.
  */
 static int
-definition_list_definition_block_dumper (dumping_params_t *params)
+definition_list_term_block_leave (dumping_params_t *params)
 {
-  int err = 0;
-  snprintf (*params->writing_ptr, *params->max_len, "* ");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
+  SINK_APPEND_LITERAL (params->sink, "**\n\n");
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : definition_list_definition_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  *params->writing_ptr += 1;
-  *params->max_len -= 1;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_GALLERY.
+ * Starts markdown for NODE_DEFINITION_LIST_DEFINITION.
  */
 static int
-gallery_block_dumper (dumping_params_t *params)
+definition_list_definition_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
+  SINK_APPEND_LITERAL (params->sink, "* ");
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : gallery_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
+  return 0;
+}
 
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
+/*
+ * Starts and ends markdown for NODE_GALLERY.
+ */
+static int
+gallery_block_enter_leave (dumping_params_t *params)
+{
+  SINK_APPEND_LITERAL (params->sink, "\n");
 
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_GALLERY_ITEM.
+ * Ends markdown for NODE_GALLERY_ITEM.
  */
 static int
-gallery_item_block_dumper (dumping_params_t *params)
+gallery_item_block_leave (dumping_params_t *params)
 {
-  int err = 0;
-
-  err = dump_media (params);
+  int err = media_leave (params);
   if (err)
     {
-      fprintf (stderr, "dumper.c : gallery_item_block_dumper() : error while dumping media.\n");
+      fprintf (stderr, "dumper.c : gallery_item_block_leave() : error while dumping media.\n");
       return err;
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
+  SINK_APPEND_LITERAL (params->sink, "\n");
 
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_GALLERY_ITEM.
+ * Starts markdown for NODE_HEADING.
  */
 static int
-heading_block_dumper (dumping_params_t *params)
+heading_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
   for (size_t i = 0; i < params->node->subtype; i++)
     {
-      snprintf (*params->writing_ptr, *params->max_len, "#");
-      (*params->writing_ptr)++;
-      (*params->max_len)--;
-    }
-
-  if (!params->node->children_len || params->node->children[0]->type != NODE_TEXT || !params->node->children[0]->text_content || !isspace (params->node->children[0]->text_content[0]))
-    {
-      snprintf (*params->writing_ptr, *params->max_len, " ");
-      (*params->writing_ptr)++;
-      (*params->max_len)--;
+      SINK_APPEND_LITERAL (params->sink, "#");
     }
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  node_t *first_child = tree_node (params->tree, params->node->first_child);
+  if (!first_child || first_child->type != NODE_TEXT || !first_child->text_len || !isspace (first_child->text_content[0]))
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : heading_block_dumper() : can't dump child.\n");
-          return err;
-        }
+      SINK_APPEND_LITERAL (params->sink, " ");
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "\n\n");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_HORIZONTAL_RULE.
+ * Ends markdown for NODE_HEADING and NODE_PARAGRAPH.
  */
 static int
-horizontal_rule_block_dumper (dumping_params_t *params)
+paragraph_block_leave (dumping_params_t *params)
 {
-  (void) params->node;
-  snprintf (*params->writing_ptr, *params->max_len, "--\n\n");
-  *params->writing_ptr += 4;
-  *params->max_len -= 4;
+  SINK_APPEND_LITERAL (params->sink, "\n\n");
 
   return 0;
 }
 
 /*
- * Generates markdown for NODE_NUMBERED_LIST.
+ * For nodes which content is not dumped: NODE_HORIZONTAL_RULE, and
+ * NODE_TABLE_CAPTION, managed in table_block_enter().
  */
-static int
-numbered_list_block_dumper (dumping_params_t *params)
+static bool
+dumps_no_child (node_t *child)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : numbered_list_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
-  return 0;
+  (void) child;
+  return false;
 }
 
 /*
- * Generates markdown for NODE_NUMBERED_LIST_ITEM.
+ * Generates markdown for NODE_HORIZONTAL_RULE.
  */
 static int
-numbered_list_item_block_dumper (dumping_params_t *params)
+horizontal_rule_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->subtype - 1; i++)
-    {
-      snprintf (*params->writing_ptr, *params->max_len, "  ");
-      *params->writing_ptr += 2;
-      *params->max_len -= 2;
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "#");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+  SINK_APPEND_LITERAL (params->sink, "--\n\n");
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : numbered_list_item_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_PREFORMATTED_TEXT.
+ * Starts markdown for NODE_NUMBERED_LIST_ITEM.
  */
 static int
-preformated_text_block_dumper (dumping_params_t *params)
+numbered_list_item_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  snprintf (*params->writing_ptr, *params->max_len, "<pre>\n");
-  *params->writing_ptr += 6;
-  *params->max_len -= 6;
+  return list_item_enter (params, "#");
+}
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+/*
+ * Starts markdown for NODE_PREFORMATTED_TEXT.
+ */
+static int
+preformated_text_block_enter (dumping_params_t *params)
+{
+  SINK_APPEND_LITERAL (params->sink, "<pre>\n");
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : preformated_text_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
+  return 0;
+}
 
-  snprintf (*params->writing_ptr, *params->max_len, "</pre>\n\n");
-  *params->writing_ptr += 8;
-  *params->max_len -= 8;
+/*
+ * Ends markdown for NODE_PREFORMATTED_TEXT.
+ */
+static int
+preformated_text_block_leave (dumping_params_t *params)
+{
+  SINK_APPEND_LITERAL (params->sink, "</pre>\n\n");
 
   return 0;
 }
 
 /*
- * Generates markdown for NODE_TABLE.
+ * Starts markdown for NODE_TABLE, with its captions.
  */
 static int
-table_block_dumper (dumping_params_t *params)
+table_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  if (params->node->children_len == 0)
+  if (!params->node->first_child)
     {
-      fprintf (stderr, "dumper.c : table_block_dumper() : empty table.\n");
+      fprintf (stderr, "dumper.c : table_block_enter() : empty table.\n");
       return 1;
     }
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  for (node_t *child = tree_node (params->tree, params->node->first_child); child; child = tree_node (params->tree, child->next_sibling))
     {
-      node_t *child = params->node->children[i];
-      if (child->is_block_level && child->type == NODE_TABLE_CAPTION && child->children_len > 0 && !child->children[0]->is_block_level && child->children[0]->type == NODE_TEXT)
+      node_t *caption = tree_node (params->tree, child->first_child);
+      if ((child->flags & NODE_BLOCK_LEVEL) && child->type == NODE_TABLE_CAPTION && caption && !(caption->flags & NODE_BLOCK_LEVEL) && caption->type == NODE_TEXT)
         {
-          char caption[*params->max_len];
-          memset (caption, 0, *params->max_len);
-          snprintf (caption, *params->max_len - 1, "**%s**\n\n", child->children[0]->text_content);
-          snprintf (*params->writing_ptr, *params->max_len, "%s", caption);
-          *params->writing_ptr += strlen (caption);
-          *params->max_len -= strlen (caption);
-        }
-    }
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      node_t *child = params->node->children[i];
-      if ((!child->is_block_level && child->type == NODE_TEXT) || (child->is_block_level && child->type == NODE_TABLE_CAPTION))
-        continue;
-
-      dumping_params_t child_params = {
-        .node = child,
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+          int err = sink_reserve (params->sink, caption->text_len + 6);
+          if (err)
+            {
+              fprintf (stderr, "dumper.c : table_block_enter() : can't reserve output space.\n");
+              return err;
+            }
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : table_block_dumper() : can't dump child.\n");
-          return err;
+          SINK_APPEND_LITERAL (params->sink, "**");
+          sink_append (params->sink, caption->text_content, caption->text_len);
+          SINK_APPEND_LITERAL (params->sink, "**\n\n");
         }
     }
 
@@ -688,612 +525,472 @@ table_block_dumper (dumping_params_t *params)
 }
 
 /*
- * Generates markdown for NODE_TABLE_CAPTION.
- *
- * NOOP: caption is managed in table_block_dumper.
+ * Text and captions of a table are not dumped as its children,
+ * captions are managed in table_block_enter().
  */
-static int
-table_caption_block_dumper (dumping_params_t *params)
+static bool
+table_block_dumps_child (node_t *child)
 {
-  (void) params->node;
-  (void) params->writing_ptr;
-  (void) params->max_len;
-  return 0;
+  if (child->flags & NODE_BLOCK_LEVEL)
+    return child->type != NODE_TABLE_CAPTION;
+
+  return child->type != NODE_TEXT;
 }
 
+
 /*
- * Generates markdown for NODE_TABLE_ROW.
+ * Starts markdown for NODE_TABLE_ROW.
  */
 static int
-table_row_block_dumper (dumping_params_t *params)
+table_row_block_enter (dumping_params_t *params)
 {
-  int err = 0;
-  bool is_header = false;
-  size_t col_count = 0;
-
-  if (params->node->children_len == 0)
+  if (!params->node->first_child)
     {
-      fprintf (stderr, "dumper.c : table_row_block_dumper() : empty row.\n");
+      fprintf (stderr, "dumper.c : table_row_block_enter() : empty row.\n");
       return 1;
     }
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      node_t *child = params->node->children[i];
-
-      if (!child->is_block_level && child->type == NODE_TEXT && strlen (child->text_content) == 0)
-        continue;
-
-      col_count++;
-
-      if (!child->is_block_level && child->type == NODE_TABLE_HEADER)
-        is_header = true;
-
-      dumping_params_t child_params = {
-        .node = child,
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : paragraph_block_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  if (is_header)
-    {
-      snprintf (*params->writing_ptr, *params->max_len, "\n--");
-      *params->writing_ptr += 3;
-      *params->max_len -= 3;
-
-      if (col_count > 1)
-        for (size_t i = 0; i < col_count - 1; i++)
-          {
-            snprintf (*params->writing_ptr, *params->max_len, "|--");
-            *params->writing_ptr += 3;
-            *params->max_len -= 3;
-          }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "\n");
-  (*params->writing_ptr)++;
-  (*params->max_len)--;
-
   return 0;
 }
 
 /*
- * Generates markdown for NODE_PARAGRAPH.
+ * Ends markdown for NODE_TABLE_ROW, underlining header rows.
  */
 static int
-paragraph_block_dumper (dumping_params_t *params)
+table_row_block_leave (dumping_params_t *params)
 {
-  int err = 0;
+  size_t col_count = params->node->non_empty_children_len;
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  if (params->node->flags & NODE_CONTAINS_HEADER_CELL)
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
+      int err = sink_reserve (params->sink, col_count * 3);
       if (err)
         {
-          fprintf (stderr, "dumper.c : paragraph_block_dumper() : can't dump child.\n");
+          fprintf (stderr, "dumper.c : table_row_block_leave() : can't reserve output space.\n");
           return err;
         }
+
+      SINK_APPEND_LITERAL (params->sink, "\n--");
+
+      if (col_count > 1)
+        for (size_t i = 0; i < col_count - 1; i++)
+          {
+            SINK_APPEND_LITERAL (params->sink, "|--");
+          }
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "\n\n");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
+  SINK_APPEND_LITERAL (params->sink, "\n");
 
   return 0;
 }
 
 /*
- * Generates markdown for NODE_EMPHASIS.
+ * Starts and ends markdown for NODE_EMPHASIS.
  */
 static int
-emphasis_inline_dumper (dumping_params_t *params)
+emphasis_inline_enter_leave (dumping_params_t *params)
 {
-  int err = 0;
-
-  snprintf (*params->writing_ptr, *params->max_len, "_");
-  *params->writing_ptr += 1;
-  *params->max_len -= 1;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : strong_and_emphasis_inline_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
-
-  snprintf (*params->writing_ptr, *params->max_len, "_");
-  *params->writing_ptr += 1;
-  *params->max_len -= 1;
+  SINK_APPEND_LITERAL (params->sink, "_");
 
-  return err;
+  return 0;
 }
 
 /*
  * Generates markdown for NODE_EXTERNAL_LINK.
  *
- * More parsing is done here to match the various components
- * of the links.
+ * Content is `url label`, the label defaulting to the url.
  */
 static int
-external_link_inline_dumper (dumping_params_t *params)
+external_link_inline_leave (dumping_params_t *params)
 {
-  int err = 0;
-
-  char link_def[MAX_LINK_LENGTH] = {0};
-  char *link_ptr = link_def;
-  size_t link_max_len = MAX_LINK_LENGTH;
+  sink_t *sink = params->sink;
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  if (!trim_link_content (sink, sink->mark + params->link_offset))
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = &link_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = &link_max_len,
-      };
-
-      int err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : external_link_inline_dumper() : error while processing link content.\n");
-          return err;
-        }
+      fprintf (stderr, "dumper.c : external_link_inline_leave() : warning : empty link detected.\n");
+      SINK_APPEND_LITERAL (sink, "about:blank _");
     }
 
-  if (strlen (link_def) == 0)
+  char *content = sink->mark + params->link_offset;
+  size_t len = sink->writing_ptr - content;
+  const char *space = memchr (content, ' ', len);
+  size_t url_len = space ? (size_t) (space - content) : len;
+  size_t text_offset = url_len;
+  while (text_offset < len && content[text_offset] == ' ')
+    text_offset++;
+
+  size_t text_len = len - text_offset;
+  if (!text_len)
     {
-      fprintf (stderr, "dumper.c : external_link_inline_dumper() : warning : empty link detected.\n");
-      snprintf (link_def, 15, "about:blank _");
+      text_offset = 0;
+      text_len = url_len;
     }
 
-  char *text = strstr (link_def, " ");
-  char url[MAX_LINK_LENGTH] = {0};
-  char escaped_url[MAX_LINK_LENGTH] = {0};
-  snprintf (url, (text ? (size_t) (text - link_def) : strlen (link_def)) + 1, "%s", link_def);
-  escape_url_for_markdown (url, escaped_url);
-
-  if (text)
-    while (text[0] == ' ')
-      text++;
+  int err = sink_reserve (sink, text_len + 3 * url_len + 4);
+  if (err)
+    {
+      fprintf (stderr, "dumper.c : external_link_inline_leave() : can't reserve output space.\n");
+      if (!params->had_mark)
+        sink->mark = NULL;
 
-  if (!text || !strlen (text))
-    text = url;
+      return err;
+    }
 
-  size_t out_len = strlen (text) + strlen (escaped_url) + 4;
-  snprintf (*params->writing_ptr, *params->max_len, "[%s](%s)", text, escaped_url);
-  *params->writing_ptr += out_len;
-  *params->max_len -= out_len;
+  content = sink->mark + params->link_offset;
+  char *markup = sink->writing_ptr;
+  SINK_APPEND_LITERAL (sink, "[");
+  sink_append (sink, content + text_offset, text_len);
+  SINK_APPEND_LITERAL (sink, "](");
+  append_url (sink, content, url_len);
+  SINK_APPEND_LITERAL (sink, ")");
+  replace_link_content (sink, content, markup, params->had_mark);
 
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_INLINE_TEMPLATE.
+ * Starts markdown for NODE_INLINE_TEMPLATE.
  */
 static int
-template_inline_dumper (dumping_params_t *params)
+template_inline_enter (dumping_params_t *params)
 {
-  int err = 0;
-
-  snprintf (*params->writing_ptr, *params->max_len, "<code>{{");
-  *params->writing_ptr += 8;
-  *params->max_len -= 8;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+  SINK_APPEND_LITERAL (params->sink, "<code>{{");
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : template_inline_dumper() : error while dumping child.\n");
-          return err;
-        }
-    }
+  return 0;
+}
 
-  snprintf (*params->writing_ptr, *params->max_len, "}}</code>");
-  *params->writing_ptr += 9;
-  *params->max_len -= 9;
+/*
+ * Ends markdown for NODE_INLINE_TEMPLATE.
+ */
+static int
+template_inline_leave (dumping_params_t *params)
+{
+  SINK_APPEND_LITERAL (params->sink, "}}</code>");
 
-  return err;
+  return 0;
 }
 
 /*
  * Generates markdown for NODE_INTERNAL_LINK.
  *
- * More parsing is done here to match the various components
- * of the links.
+ * Content is `page|label`, the label defaulting to the page name.
  */
 static int
-internal_link_inline_dumper (dumping_params_t *params)
+internal_link_inline_leave (dumping_params_t *params)
 {
-  int err = 0;
-  char link_def[MAX_LINK_LENGTH] = {0};
-  char *link_ptr = link_def;
-  size_t link_max_len = MAX_LINK_LENGTH;
+  sink_t *sink = params->sink;
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  if (!trim_link_content (sink, sink->mark + params->link_offset))
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = &link_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = &link_max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : internal_link_inline_dumper() : error while processing link content.\n");
-          return 1;
-        }
+      fprintf (stderr, "dumper.c : internal_link_inline_leave() : warning : empty link detected.\n");
+      SINK_APPEND_LITERAL (sink, "redlink");
     }
 
-  if (strlen (link_def) == 0)
+  char *content = sink->mark + params->link_offset;
+  size_t len = sink->writing_ptr - content;
+  const char *pipe = memchr (content, '|', len);
+  size_t url_len = pipe ? (size_t) (pipe - content) : len;
+  size_t text_offset = pipe ? url_len + 1 : len;
+  size_t text_len = len - text_offset;
+  if (!text_len)
     {
-      fprintf (stderr, "dumper.c : internal_link_inline_dumper() : warning : empty link detected.\n");
-      snprintf (link_def, 15, "redlink");
+      text_offset = 0;
+      text_len = url_len;
     }
 
-  char *text = strstr (link_def, "|");
-  char url[MAX_LINK_LENGTH] = {0};
-  char escaped_url[MAX_LINK_LENGTH] = {0};
-  size_t max_len = (text ? (size_t) (text - link_def) : strlen (link_def)) + 1;
-  if (max_len > MAX_LINK_LENGTH)
-    max_len = MAX_LINK_LENGTH;
-
-  snprintf (url, max_len, "%s", link_def);
-  escape_url_for_markdown (url, escaped_url);
+  int err = sink_reserve (sink, text_len + 3 * url_len + 7);
+  if (err)
+    {
+      fprintf (stderr, "dumper.c : internal_link_inline_leave() : can't reserve output space.\n");
+      if (!params->had_mark)
+        sink->mark = NULL;
 
-  if (text)
-    text++;
+      return err;
+    }
 
-  if (!text || !strlen (text))
-    text = url;
+  content = sink->mark + params->link_offset;
+  char *markup = sink->writing_ptr;
+  SINK_APPEND_LITERAL (sink, "[");
+  sink_append (sink, content + text_offset, text_len);
+  SINK_APPEND_LITERAL (sink, "](");
+  append_url (sink, content, url_len);
+  SINK_APPEND_LITERAL (sink, ".md)");
+  replace_link_content (sink, content, markup, params->had_mark);
 
-  size_t out_len = strlen (text) + strlen (escaped_url) + 7;
-  if (out_len > *params->max_len)
-    out_len = *params->max_len - 1;
+  return 0;
+}
 
-  snprintf (*params->writing_ptr, *params->max_len - 1, "[%s](%s.md)", text, escaped_url);
-  *params->writing_ptr += out_len;
-  *params->max_len -= out_len;
+/*
+ * Starts and ends markdown for NODE_STRONG.
+ */
+static int
+strong_inline_enter_leave (dumping_params_t *params)
+{
+  SINK_APPEND_LITERAL (params->sink, "**");
 
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_MEDIA.
+ * Starts markdown for NODE_STRONG_AND_EMPHASIS.
  */
 static int
-media_inline_dumper (dumping_params_t *params)
+strong_and_emphasis_inline_enter (dumping_params_t *params)
 {
-  return dump_media (params);
+  SINK_APPEND_LITERAL (params->sink, "**_");
+
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_STRONG.
+ * Ends markdown for NODE_STRONG_AND_EMPHASIS.
  */
 static int
-strong_inline_dumper (dumping_params_t *params)
+strong_and_emphasis_inline_leave (dumping_params_t *params)
 {
-  int err = 0;
+  SINK_APPEND_LITERAL (params->sink, "_**");
 
-  snprintf (*params->writing_ptr, *params->max_len, "**");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
+  return 0;
+}
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+/*
+ * Ends markdown for NODE_TABLE_HEADER and NODE_TABLE_CELL.
+ */
+static int
+table_cell_inline_leave (dumping_params_t *params)
+{
+  if (params->node->id != tree_node (params->tree, params->node->parent)->last_child)
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
-
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : strong_inline_dumper() : can't dump child.\n");
-          return err;
-        }
+      SINK_APPEND_LITERAL (params->sink, "|");
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "**");
-  *params->writing_ptr += 2;
-  *params->max_len -= 2;
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_STRONG_AND_EMPHASIS.
+ * Generates markdown for NODE_TEXT.
  */
 static int
-strong_and_emphasis_inline_dumper (dumping_params_t *params)
+text_inline_enter (dumping_params_t *params)
 {
-  int err = 0;
+  int err = sink_write (params->sink, params->node->text_content, params->node->text_len);
+  if (err)
+    fprintf (stderr, "dumper.c : text_inline_enter() : can't write text.\n");
 
-  snprintf (*params->writing_ptr, *params->max_len, "**_");
-  *params->writing_ptr += 3;
-  *params->max_len -= 3;
+  return err;
+}
 
-  for (size_t i = 0; i < params->node->children_len; i++)
-    {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+/*
+ * Dumpers of block level nodes.
+ */
+static const dumper_def_t template_block_dumper = { .type = NODE_BLOCKLEVEL_TEMPLATE, .enter = template_block_enter, .leave = template_block_leave };
+static const dumper_def_t bullet_list_block_dumper = { .type = NODE_BULLET_LIST, .leave = list_block_leave };
+static const dumper_def_t bullet_list_item_block_dumper = { .type = NODE_BULLET_LIST_ITEM, .enter = bullet_list_item_block_enter, .leave = list_block_leave };
+static const dumper_def_t definition_list_block_dumper = { .type = NODE_DEFINITION_LIST, .leave = list_block_leave };
+static const dumper_def_t definition_list_term_block_dumper = { .type = NODE_DEFINITION_LIST_TERM, .enter = definition_list_term_block_enter, .leave = definition_list_term_block_leave };
+static const dumper_def_t definition_list_definition_block_dumper = { .type = NODE_DEFINITION_LIST_DEFINITION, .enter = definition_list_definition_block_enter, .leave = list_block_leave };
+static const dumper_def_t gallery_block_dumper = { .type = NODE_GALLERY, .enter = gallery_block_enter_leave, .leave = gallery_block_enter_leave };
+static const dumper_def_t gallery_item_block_dumper = { .type = NODE_GALLERY_ITEM, .enter = media_enter, .leave = gallery_item_block_leave };
+static const dumper_def_t heading_block_dumper = { .type = NODE_HEADING, .enter = heading_block_enter, .leave = paragraph_block_leave };
+static const dumper_def_t horizontal_rule_block_dumper = { .type = NODE_HORIZONTAL_RULE, .enter = horizontal_rule_block_enter, .dumps_child = dumps_no_child };
+static const dumper_def_t numbered_list_block_dumper = { .type = NODE_NUMBERED_LIST, .leave = list_block_leave };
+static const dumper_def_t numbered_list_item_block_dumper = { .type = NODE_NUMBERED_LIST_ITEM, .enter = numbered_list_item_block_enter, .leave = list_block_leave };
+static const dumper_def_t preformatted_text_block_dumper = { .type = NODE_PREFORMATTED_TEXT, .enter = preformated_text_block_enter, .leave = preformated_text_block_leave };
+static const dumper_def_t table_block_dumper = { .type = NODE_TABLE, .enter = table_block_enter, .dumps_child = table_block_dumps_child };
+static const dumper_def_t table_caption_block_dumper = { .type = NODE_TABLE_CAPTION, .dumps_child = dumps_no_child };
+static const dumper_def_t table_row_block_dumper = { .type = NODE_TABLE_ROW, .enter = table_row_block_enter, .leave = table_row_block_leave };
+static const dumper_def_t paragraph_block_dumper = { .type = NODE_PARAGRAPH, .leave = paragraph_block_leave };
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : strong_and_emphasis_inline_dumper() : can't dump child.\n");
-          return err;
-        }
-    }
+/*
+ * Indexed by node type, with the dumper of each type of BLOCK_LEVEL_NODE_TYPES.
+ */
+#define BLOCK_DUMPER(node_type, name) [node_type] = &name##_block_dumper,
+static const dumper_def_t *const block_dumpers[] = {
+  BLOCK_LEVEL_NODE_TYPES (BLOCK_DUMPER)
+};
 
-  snprintf (*params->writing_ptr, *params->max_len, "_**");
-  *params->writing_ptr += 3;
-  *params->max_len -= 3;
+_Static_assert (sizeof block_dumpers / sizeof *block_dumpers == BLOCK_LEVEL_NODES_COUNT, "block_dumpers must have one entry per node type.");
 
-  return err;
-}
+/*
+ * Dumpers of inline nodes.
+ */
+static const dumper_def_t emphasis_inline_dumper = { .type = NODE_EMPHASIS, .enter = emphasis_inline_enter_leave, .leave = emphasis_inline_enter_leave };
+static const dumper_def_t external_link_inline_dumper = { .type = NODE_EXTERNAL_LINK, .enter = link_enter, .leave = external_link_inline_leave };
+static const dumper_def_t template_inline_dumper = { .type = NODE_INLINE_TEMPLATE, .enter = template_inline_enter, .leave = template_inline_leave };
+static const dumper_def_t internal_link_inline_dumper = { .type = NODE_INTERNAL_LINK, .enter = link_enter, .leave = internal_link_inline_leave };
+static const dumper_def_t media_inline_dumper = { .type = NODE_MEDIA, .enter = media_enter, .leave = media_leave };
+static const dumper_def_t strong_inline_dumper = { .type = NODE_STRONG, .enter = strong_inline_enter_leave, .leave = strong_inline_enter_leave };
+static const dumper_def_t strong_and_emphasis_inline_dumper = { .type = NODE_STRONG_AND_EMPHASIS, .enter = strong_and_emphasis_inline_enter, .leave = strong_and_emphasis_inline_leave };
+static const dumper_def_t table_header_inline_dumper = { .type = NODE_TABLE_HEADER, .leave = table_cell_inline_leave };
+static const dumper_def_t table_cell_inline_dumper = { .type = NODE_TABLE_CELL, .leave = table_cell_inline_leave };
+static const dumper_def_t text_inline_dumper = { .type = NODE_TEXT, .enter = text_inline_enter };
 
 /*
- * Generates markdown for NODE_TABLE_HEADER.
+ * Indexed by node type, with the dumper of each type of INLINE_NODE_TYPES.
  */
-static int
-table_header_inline_dumper (dumping_params_t *params)
+#define INLINE_DUMPER(node_type, name) [node_type] = &name##_inline_dumper,
+static const dumper_def_t *const inline_dumpers[] = {
+  INLINE_NODE_TYPES (INLINE_DUMPER)
+};
+
+_Static_assert (sizeof inline_dumpers / sizeof *inline_dumpers == INLINE_NODES_COUNT, "inline_dumpers must have one entry per node type.");
+
+/*
+ * The root only holds top level nodes.
+ */
+static const dumper_def_t root_dumper = { .type = NODE_ROOT };
+
+/*
+ * Find the dumper for `node`, or NULL if its type is unknown or if
+ * it has no handler.
+ */
+static const dumper_def_t *
+find_dumper (node_t *node)
 {
-  int err = 0;
+  const dumper_def_t *dumper = NULL;
 
-  for (size_t i = 0; i < params->node->children_len; i++)
+  if (node->flags & NODE_BLOCK_LEVEL)
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+      if (node->type == NODE_ROOT)
+        return &root_dumper;
 
-      err = dump (&child_params);
-      if (err)
-        {
-          fprintf (stderr, "dumper.c : table_cell_inline_dumper() : can't dump child.\n");
-          return err;
-        }
+      if (node->type < BLOCK_LEVEL_NODES_COUNT)
+        dumper = block_dumpers[node->type];
     }
+  else if (node->type < INLINE_NODES_COUNT)
+    dumper = inline_dumpers[node->type];
 
-  if (params->node != params->node->parent->last_child)
+  if (!dumper || (!dumper->enter && !dumper->leave && !dumper->dumps_child))
     {
-      snprintf (*params->writing_ptr, *params->max_len, "|");
-      *params->writing_ptr += 1;
-      *params->max_len -= 1;
+      fprintf (stderr, "dumper.c : find_dumper() : no dumper for %s node type : %d\n", node->flags & NODE_BLOCK_LEVEL ? "block level" : "inline", node->type);
+      return NULL;
     }
 
-
-  return err;
+  return dumper;
 }
 
 /*
- * Generates markdown for NODE_TABLE_CELL.
+ * Start dumping the node of `frame`, which children are dumped next.
  */
 static int
-table_cell_inline_dumper (dumping_params_t *params)
+enter_node (dumping_frame_t *frame)
 {
-  int err = 0;
-
-  for (size_t i = 0; i < params->node->children_len; i++)
+  int err = sink_reserve (frame->params.sink, SINK_MARGIN);
+  if (err)
     {
-      dumping_params_t child_params = {
-        .node = params->node->children[i],
-        .writing_ptr = params->writing_ptr,
-        .start_of_buffer = params->start_of_buffer,
-        .max_len = params->max_len,
-      };
+      fprintf (stderr, "dumper.c : enter_node() : can't reserve output space.\n");
+      return err;
+    }
+
+  frame->dumper = find_dumper (frame->params.node);
+  if (!frame->dumper)
+    return 1;
 
-      err = dump (&child_params);
+  frame->next_child = tree_node (frame->params.tree, frame->params.node->first_child);
+
+  if (frame->dumper->enter)
+    {
+      err = frame->dumper->enter (&frame->params);
       if (err)
         {
-          fprintf (stderr, "dumper.c : table_cell_inline_dumper() : can't dump child.\n");
+          fprintf (stderr, "dumper.c : enter_node() : error while dumping %s node.\n", frame->params.node->flags & NODE_BLOCK_LEVEL ? "block level" : "inline");
           return err;
         }
     }
 
-  if (params->node != params->node->parent->last_child)
-    {
-      snprintf (*params->writing_ptr, *params->max_len, "|");
-      *params->writing_ptr += 1;
-      *params->max_len -= 1;
-    }
-
-
-  return err;
+  return 0;
 }
 
 /*
- * Generates markdown for NODE_TEXT.
+ * Finish dumping the node of `frame`, once its children have been.
  */
 static int
-text_inline_dumper (dumping_params_t *params)
+leave_node (dumping_frame_t *frame)
 {
   int err = 0;
 
-  size_t len = strlen (params->node->text_content);
-  if (*params->max_len < len)
+  if (frame->dumper->leave)
     {
-      fprintf (stderr, "dumper.c : text_inline_dumper() : output content too long.\n");
-      return 1;
+      err = frame->dumper->leave (&frame->params);
+      if (err)
+        {
+          fprintf (stderr, "dumper.c : leave_node() : error while dumping %s node.\n", frame->params.node->flags & NODE_BLOCK_LEVEL ? "block level" : "inline");
+          return err;
+        }
     }
 
-  snprintf (*params->writing_ptr, *params->max_len, "%s", params->node->text_content);
-  *params->writing_ptr += len;
-  *params->max_len -= len;
+  err = sink_reserve (frame->params.sink, SINK_MARGIN);
+  if (err)
+    {
+      fprintf (stderr, "dumper.c : leave_node() : can't reserve output space.\n");
+      return err;
+    }
 
-  return err;
+  return 0;
 }
 
-dumper_def_t block_dumpers[BLOCK_LEVEL_NODES_COUNT] = {
-  { .type = NODE_BLOCKLEVEL_TEMPLATE, .handler = template_block_dumper },
-  { .type = NODE_BULLET_LIST, .handler = bullet_list_block_dumper },
-  { .type = NODE_BULLET_LIST_ITEM, .handler = bullet_list_item_block_dumper },
-  { .type = NODE_DEFINITION_LIST, .handler = definition_list_block_dumper },
-  { .type = NODE_DEFINITION_LIST_TERM, .handler = definition_list_term_block_dumper },
-  { .type = NODE_DEFINITION_LIST_DEFINITION, .handler = definition_list_definition_block_dumper },
-  { .type = NODE_GALLERY, .handler = gallery_block_dumper },
-  { .type = NODE_GALLERY_ITEM, .handler = gallery_item_block_dumper },
-  { .type = NODE_HEADING, .handler = heading_block_dumper },
-  { .type = NODE_HORIZONTAL_RULE, .handler = horizontal_rule_block_dumper },
-  { .type = NODE_NUMBERED_LIST, .handler = numbered_list_block_dumper },
-  { .type = NODE_NUMBERED_LIST_ITEM, .handler = numbered_list_item_block_dumper },
-  { .type = NODE_PREFORMATTED_TEXT, .handler = preformated_text_block_dumper },
-  { .type = NODE_TABLE, .handler = table_block_dumper },
-  { .type = NODE_TABLE_CAPTION, .handler = table_caption_block_dumper },
-  { .type = NODE_TABLE_ROW, .handler = table_row_block_dumper },
-  { .type = NODE_PARAGRAPH, .handler = paragraph_block_dumper },
-};
-
-dumper_def_t inline_dumpers[INLINE_NODES_COUNT] = {
-  { .type = NODE_EMPHASIS, .handler = emphasis_inline_dumper },
-  { .type = NODE_EXTERNAL_LINK, .handler = external_link_inline_dumper },
-  { .type = NODE_INLINE_TEMPLATE, .handler = template_inline_dumper },
-  { .type = NODE_INTERNAL_LINK, .handler = internal_link_inline_dumper },
-  { .type = NODE_MEDIA, .handler = media_inline_dumper },
-  { .type = NODE_STRONG, .handler = strong_inline_dumper },
-  { .type = NODE_STRONG_AND_EMPHASIS, .handler = strong_and_emphasis_inline_dumper },
-  { .type = NODE_TABLE_HEADER, .handler = table_header_inline_dumper },
-  { .type = NODE_TABLE_CELL, .handler = table_cell_inline_dumper },
-  { .type = NODE_TEXT, .handler = text_inline_dumper },
-};
-
 /*
  * Convert given node to markdown and output it.
  *
- * The converted content will be dumped into `writing_ptr`, up
- * to max_len. `writing_ptr` will be advanced to the next position
- * of available space, and `max_len` will be reduced by the written
- * content length.
+ * The converted content is added to `params->sink`.
+ *
+ * The tree is walked depth first with a stack of frames on the heap,
+ * so how deep it is doesn't matter: each node is entered, then its
+ * children are dumped, then it's left.
+ *
+ * SINK_MARGIN bytes are available in the sink when a dumper callback
+ * starts and when it returns, so callbacks only need to reserve space
+ * explicitly for content of arbitrary length.
  */
 int
 dump (dumping_params_t *params)
 {
-  int err = 0;
+  bool had_mark = params->sink->mark != NULL;
+  size_t capacity = DUMPING_STACK_SIZE;
+  size_t depth = 1;
+  dumping_frame_t *stack = xalloc (capacity * sizeof *stack);
 
-  if (*params->max_len < 10)
-    {
-      fprintf (stderr, "dumper.c : dump() : output content too long.\n");
-      return 1;
-    }
+  stack[0].params = *params;
+  int err = enter_node (&stack[0]);
 
-  if (params->node->is_block_level)
+  while (!err && depth)
     {
-      if (params->node->type == NODE_ROOT)
-        {
-          for (size_t i = 0; i < params->node->children_len; i++)
-            {
-              dumping_params_t child_params = {
-                .node = params->node->children[i],
-                .writing_ptr = params->writing_ptr,
-                .start_of_buffer = params->start_of_buffer,
-                .max_len = params->max_len,
-              };
-
-              err = dump (&child_params);
-              if (err)
-                {
-                  fprintf (stderr, "dumper.c : dump() : error while dumping top level node.\n");
-                  return err;
-                }
-            }
-        }
-      else
-        {
-          bool found = false;
-          for (size_t i = 0; i < BLOCK_LEVEL_NODES_COUNT; i++)
-            {
-              dumper_def_t def = block_dumpers[i];
-              if (def.type == params->node->type)
-                {
-                  found = true;
-
-                  err = def.handler (params);
-                  if (err)
-                    {
-                      fprintf (stderr, "dumper.c : dump() : error while dumping block level node.\n");
-                      return err;
-                    }
-                  break;
-                }
-            }
+      dumping_frame_t *frame = &stack[depth - 1];
 
-          if (!found)
-            {
-              fprintf (stderr, "dumper.c : dump() : unknown node type : %ld\n", params->node->type);
-              return 1;
-            }
-        }
-    }
-  else
-    {
-      bool found = false;
-      for (size_t i = 0; i < INLINE_NODES_COUNT; i++)
+      while (frame->next_child && frame->dumper->dumps_child && !frame->dumper->dumps_child (frame->next_child))
+        frame->next_child = tree_node (params->tree, frame->next_child->next_sibling);
+
+      if (!frame->next_child)
         {
-          dumper_def_t def = inline_dumpers[i];
-          if (def.type == params->node->type)
-            {
-              found = true;
-
-              err = def.handler (params);
-              if (err)
-                {
-                  fprintf (stderr, "dumper.c : dump() : error while dumping inline node.\n");
-                  return err;
-                }
-              break;
-            }
+          err = leave_node (frame);
+          depth--;
+          continue;
         }
 
-      if (!found)
+      node_t *child = frame->next_child;
+      frame->next_child = tree_node (params->tree, child->next_sibling);
+      if (depth == capacity)
         {
-          fprintf (stderr, "dumper.c : dump() : unknown inline node type : %ld\n", params->node->type);
-          return 1;
+          capacity *= 2;
+          stack = xrealloc (stack, capacity * sizeof *stack);
         }
+
+      stack[depth] = (dumping_frame_t) {
+        .params = {
+          .tree = params->tree,
+          .node = child,
+          .sink = params->sink,
+        },
+      };
+
+      depth++;
+      err = enter_node (&stack[depth - 1]);
     }
 
+  if (err && !had_mark)
+    params->sink->mark = NULL;
+
+  free (stack);
+
   return err;
 }
@@ -2,12 +2,16 @@
 #define _DUMPER_H_
 
 #include "parser.h"
+#include "sink.h"
 
 typedef struct {
+  const tree_t *tree;
   node_t *node;
-  char **writing_ptr;
-  const char *start_of_buffer;
-  size_t *max_len;
+  sink_t *sink;
+
+  // state of link dumpers, from entering the node to leaving it.
+  size_t link_offset;
+  bool had_mark;
 } dumping_params_t;
 
 int dump (dumping_params_t *params);
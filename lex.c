@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lex.h"
+
+/*
+ * Kind of the tokens made of a single byte, or starting with it.
+ * Bytes which are not listed are text.
+ */
+static const int first_byte_kinds[256] = {
+  ['\n'] = TOKEN_NEWLINE,
+  [' '] = TOKEN_SPACE,
+  ['*'] = TOKEN_ASTERISK,
+  ['#'] = TOKEN_HASH,
+  [':'] = TOKEN_COLON,
+  [';'] = TOKEN_SEMICOLON,
+  ['\''] = TOKEN_QUOTES,
+  ['='] = TOKEN_EQUALS,
+  ['-'] = TOKEN_DASHES,
+  ['['] = TOKEN_OPEN_BRACKET,
+  [']'] = TOKEN_CLOSE_BRACKET,
+  ['|'] = TOKEN_PIPE,
+  ['!'] = TOKEN_BANG,
+};
+
+/*
+ * Find the token starting at `ptr`, without looking at what's next.
+ */
+static token_t
+lex_one (const char *ptr)
+{
+  token_t token = { .kind = first_byte_kinds[(unsigned char) ptr[0]], .len = 1 };
+
+  switch (ptr[0])
+    {
+      case 0:
+        token.kind = TOKEN_END;
+        token.len = 0;
+        break;
+
+      case '\'':
+      case '=':
+      case '-':
+        while (token.len < TOKEN_MAX_RUN && ptr[token.len] == ptr[0])
+          token.len++;
+        break;
+
+      case '[':
+        if (ptr[1] == '[')
+          {
+            token.kind = TOKEN_OPEN_LINK;
+            token.len = 2;
+
+            if (strncmp (ptr + 2, "File:", 5) == 0)
+              {
+                token.kind = TOKEN_OPEN_MEDIA;
+                token.len = 7;
+              }
+          }
+        break;
+
+      case ']':
+        if (ptr[1] == ']')
+          {
+            token.kind = TOKEN_CLOSE_LINK;
+            token.len = 2;
+          }
+        break;
+
+      case '{':
+        if (ptr[1] == '{')
+          {
+            token.kind = TOKEN_OPEN_TEMPLATE;
+            token.len = 2;
+          }
+        else if (ptr[1] == '|')
+          {
+            token.kind = TOKEN_OPEN_TABLE;
+            token.len = 2;
+          }
+        break;
+
+      case '}':
+        if (ptr[1] == '}')
+          {
+            token.kind = TOKEN_CLOSE_TEMPLATE;
+            token.len = 2;
+          }
+        break;
+
+      case '|':
+        token.len = 2;
+        switch (ptr[1])
+          {
+            case '}': token.kind = TOKEN_CLOSE_TABLE; break;
+            case '-': token.kind = TOKEN_TABLE_ROW; break;
+            case '+': token.kind = TOKEN_TABLE_CAPTION; break;
+            case '|': token.kind = TOKEN_CELL_SEPARATOR; break;
+            default: token.len = 1;
+          }
+        break;
+
+      case '!':
+        if (ptr[1] == '!')
+          {
+            token.kind = TOKEN_HEADER_SEPARATOR;
+            token.len = 2;
+          }
+        break;
+
+      case '<':
+        if (strncmp (ptr, "<nowiki>", 8) == 0)
+          {
+            token.kind = TOKEN_OPEN_NOWIKI;
+            token.len = 8;
+          }
+        else if (strncmp (ptr, "</nowiki>", 9) == 0)
+          {
+            token.kind = TOKEN_CLOSE_NOWIKI;
+            token.len = 9;
+          }
+        else if (strncmp (ptr, "<gallery>", 9) == 0)
+          {
+            token.kind = TOKEN_OPEN_GALLERY;
+            token.len = 9;
+          }
+        else if (strncmp (ptr, "</gallery>", 10) == 0)
+          {
+            token.kind = TOKEN_CLOSE_GALLERY;
+            token.len = 10;
+          }
+        break;
+    }
+
+  return token;
+}
+
+/*
+ * Find the markup token starting at `ptr`, which must be NUL terminated.
+ *
+ * This is a single pass over the few bytes of the token: the first byte
+ * decides what the next ones can be.
+ */
+token_t
+lex (const char *ptr)
+{
+  token_t token = lex_one (ptr);
+
+  if (token.kind == TOKEN_NEWLINE || token.kind == TOKEN_PIPE || token.kind == TOKEN_BANG)
+    {
+      token_t next = lex_one (ptr + token.len);
+      token.next_kind = next.kind;
+      token.next_len = next.len;
+    }
+
+  return token;
+}
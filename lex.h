@@ -0,0 +1,60 @@
+#ifndef _LEX_H_
+#define _LEX_H_
+
+/*
+ * Longest run of a repeated markup character that is measured.
+ * Parsers never need to know about more than 7 `=` or 5 `'`.
+ */
+#define TOKEN_MAX_RUN 8
+
+enum {
+  TOKEN_TEXT,               // any other byte
+  TOKEN_END,                // NUL byte
+  TOKEN_NEWLINE,            // \n
+  TOKEN_SPACE,              // ' '
+  TOKEN_ASTERISK,           // *
+  TOKEN_HASH,               // #
+  TOKEN_COLON,              // :
+  TOKEN_SEMICOLON,          // ;
+  TOKEN_QUOTES,             // run of '
+  TOKEN_EQUALS,             // run of =
+  TOKEN_DASHES,             // run of -
+  TOKEN_OPEN_BRACKET,       // [
+  TOKEN_OPEN_LINK,          // [[
+  TOKEN_OPEN_MEDIA,         // [[File:
+  TOKEN_CLOSE_BRACKET,      // ]
+  TOKEN_CLOSE_LINK,         // ]]
+  TOKEN_OPEN_TEMPLATE,      // {{
+  TOKEN_CLOSE_TEMPLATE,     // }}
+  TOKEN_OPEN_TABLE,         // {|
+  TOKEN_CLOSE_TABLE,        // |}
+  TOKEN_TABLE_ROW,          // |-
+  TOKEN_TABLE_CAPTION,      // |+
+  TOKEN_CELL_SEPARATOR,     // ||
+  TOKEN_PIPE,               // |
+  TOKEN_HEADER_SEPARATOR,   // !!
+  TOKEN_BANG,               // !
+  TOKEN_OPEN_NOWIKI,        // <nowiki>
+  TOKEN_CLOSE_NOWIKI,       // </nowiki>
+  TOKEN_OPEN_GALLERY,       // <gallery>
+  TOKEN_CLOSE_GALLERY,      // </gallery>
+  TOKENS_COUNT,
+};
+
+/*
+ * Markup found at a position of the input.
+ *
+ * Tokens which meaning depends on what follows them (newlines, pipes
+ * and bangs) also tell about the next token, with `next_kind` and
+ * `next_len`. For other tokens, those are left to TOKEN_TEXT and 0.
+ */
+typedef struct {
+  int kind;
+  size_t len;
+  int next_kind;
+  size_t next_len;
+} token_t;
+
+token_t lex (const char *ptr);
+
+#endif
@@ -9,26 +9,114 @@
 #include <string.h>
 #include <unistd.h>
 
-#include "dumper.h"
-#include "parser.h"
-#include "utils.h"
+#include "batch.h"
+#include "sink.h"
+#include "wiki2md.h"
 
 static void
 usage (const char *progname)
 {
   printf ("\
 %s [-h|--help] <wikitext-file> \n\
+%s --batch [-o <output-dir>] [-j <threads>] [wikitext-file...] \n\
+%s --xml <dump-file> [-o <output-dir>] [-j <threads>] \n\
 \n\
 Convert the provided file in mediawiki markup to markdown, printed on stdout. \n\
-  ", progname);
+\n\
+With --batch, convert each file to a markdown file with the same name and \n\
+the .md extension, next to it or in <output-dir>. When no file is provided, \n\
+a NUL separated list of files is read from stdin (like with `find -print0`). \n\
+Files are converted on <threads> threads (1 by default). Using -j without \n\
+--batch implies it. \n\
+\n\
+With --xml, convert each page of a MediaWiki XML dump (like pages-articles.xml) \n\
+to a markdown file named after its title in <output-dir>, or to stdout, each \n\
+page starting with its title as a heading. With -j, pages are converted on \n\
+<threads> threads, and still output in the order of the dump. \n\
+  ", progname, progname, progname);
+}
+
+/*
+ * Handle `--batch` and `--xml` modes, `argv` being the arguments
+ * following the program name.
+ */
+static int
+batch (int argc, char **argv)
+{
+  const char *output_dir = NULL;
+  const char *dump = NULL;
+  size_t jobs = 1;
+  file_list_t list = {0};
+
+  while (argc > 0 && argv[0][0] == '-')
+    {
+      if (strcmp (argv[0], "--batch") != 0 && argc < 2)
+        {
+          fprintf (stderr, "main.c : batch() : %s requires a value.\n", argv[0]);
+          return 1;
+        }
+
+      if (strcmp (argv[0], "--batch") == 0)
+        {
+          argc--;
+          argv++;
+          continue;
+        }
+
+      if (strcmp (argv[0], "-o") == 0)
+        output_dir = argv[1];
+      else if (strcmp (argv[0], "--xml") == 0)
+        dump = argv[1];
+      else if (strcmp (argv[0], "-j") == 0)
+        {
+          char *end = NULL;
+          long value = strtol (argv[1], &end, 10);
+          if (end == argv[1] || *end || value < 1 || value > BATCH_MAX_JOBS)
+            {
+              fprintf (stderr, "main.c : batch() : -j expects a number of threads between 1 and %d.\n", BATCH_MAX_JOBS);
+              return 1;
+            }
+
+          jobs = value;
+        }
+      else
+        {
+          fprintf (stderr, "main.c : batch() : unknown option %s\n", argv[0]);
+          return 1;
+        }
+
+      argc -= 2;
+      argv += 2;
+    }
+
+  if (dump)
+    {
+      if (argc > 0)
+        {
+          fprintf (stderr, "main.c : batch() : --xml doesn't take other files.\n");
+          return 1;
+        }
+
+      return batch_convert_dump (dump, output_dir, jobs);
+    }
+
+  if (argc > 0)
+    return batch_convert (argv, argc, output_dir, jobs);
+
+  int err = batch_read_list (&list, stdin);
+  if (!err)
+    err = batch_convert (list.paths, list.count, output_dir, jobs);
+
+  batch_free_list (&list);
+  return err;
 }
 
 int
 main (int argc, char **argv)
 {
   int err = 0;
-  node_t *root = NULL;
-  char *content = NULL;
+  w2m_ctx_t *ctx = NULL;
+  sink_t sink = {0};
 
   if (argc > 1 && (strncmp (argv[1], "-h", 10) == 0 || strncmp (argv[1], "--help", 10) == 0))
     {
@@ -36,6 +124,12 @@ main (int argc, char **argv)
       goto cleanup;
     }
 
+  if (argc > 1 && (strcmp (argv[1], "--batch") == 0 || strcmp (argv[1], "-j") == 0 || strcmp (argv[1], "--xml") == 0))
+    {
+      err = batch (argc - 1, argv + 1);
+      goto cleanup;
+    }
+
   if (argc != 2)
     {
       err = 1;
@@ -52,39 +146,18 @@ main (int argc, char **argv)
       goto cleanup;
     }
 
-  root = xalloc (sizeof *root);
-  root->type = NODE_ROOT;
-  root->is_block_level = true;
-  root->can_have_block_children = true;
-  err = parse (filename, root);
-  if (err)
-    {
-      fprintf (stderr, "main.c : main() : error while building representation of file.\n");
-      goto cleanup;
-    }
-
-  content = xalloc (MAX_FILE_SIZE);
-  size_t max_len = MAX_FILE_SIZE - 1;
-  char *writing_ptr = content;
+  ctx = w2m_ctx_new ();
+  sink_init (&sink, STDOUT_FILENO, SINK_BUFFER_SIZE);
 
-  dumping_params_t params = {
-    .node = root,
-    .writing_ptr = &writing_ptr,
-    .start_of_buffer = content,
-    .max_len = &max_len,
-  };
-
-  err = dump (&params);
+  err = w2m_convert_file (ctx, filename, &sink);
   if (err)
     {
-      fprintf (stderr, "main.c : main() : error while dumping markdown.\n");
+      fprintf (stderr, "main.c : main() : can't convert file %s\n", filename);
       goto cleanup;
     }
 
-  puts (content);
-
   cleanup:
-  if (root) free_node (root);
-  if (content) free (content);
+  w2m_ctx_free (ctx);
+  if (sink.buffer) sink_release (&sink);
   return err;
 }
@@ -6,10 +6,12 @@
 #include "utils.h"
 
 typedef struct {
+  parser_state_t *state;
   node_t *current_node;
   node_t *block;
-  node_t **next_item;
+  bool *opens_next_item;
   char **reading_ptr;
+  token_t *token;
   bool *close_parent_too;
 
   node_t *new_node;
@@ -21,13 +23,42 @@ typedef struct {
   parsing_block_end_t *handler;
 } parser_def_t;
 
+/*
+ * Tell if `token` is a newline followed by a token of `kind`,
+ * at least `min_len` long.
+ */
+static bool
+starts_line_with (token_t *token, int kind, size_t min_len)
+{
+  return token->kind == TOKEN_NEWLINE && token->next_kind == kind && token->next_len >= min_len;
+}
+
+/*
+ * Tell if `token` starts a rule or a heading line.
+ */
+static bool
+starts_section_line (token_t *token)
+{
+  return starts_line_with (token, TOKEN_DASHES, 4) || starts_line_with (token, TOKEN_EQUALS, 2);
+}
+
+/*
+ * Tell if `token` starts an empty line, a rule or a heading, which
+ * end lists and paragraphs.
+ */
+static bool
+ends_list (token_t *token)
+{
+  return starts_line_with (token, TOKEN_NEWLINE, 1) || starts_section_line (token);
+}
+
 /*
  * Parsing block end for NODE_BLOCKLEVEL_TEMPLATE.
  */
 static bool
 template_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "}}", 2) == 0 && (params->current_node->type != NODE_INLINE_TEMPLATE))
+  if (params->token->kind == TOKEN_CLOSE_TEMPLATE && (params->current_node->type != NODE_INLINE_TEMPLATE))
     {
       *params->reading_ptr += 2;
       return true;
@@ -42,7 +73,7 @@ template_block_end_parser (parsing_block_end_params_t *params)
 static bool
 bullet_list_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0)
+  if (ends_list (params->token))
     return true;
 
   return false;
@@ -54,8 +85,8 @@ bullet_list_block_end_parser (parsing_block_end_params_t *params)
 static bool
 bullet_list_item_block_end_parser (parsing_block_end_params_t *params)
 {
-  bool is_end_of_list = strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
-  bool is_end_of_item = strncmp (*params->reading_ptr, "\n*", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
+  bool is_end_of_list = ends_list (params->token);
+  bool is_end_of_item = starts_line_with (params->token, TOKEN_ASTERISK, 1) || starts_section_line (params->token);
 
   if (is_end_of_list || is_end_of_item)
     {
@@ -75,9 +106,9 @@ bullet_list_item_block_end_parser (parsing_block_end_params_t *params)
 static bool
 definition_list_term_block_end_parser (parsing_block_end_params_t *params)
 {
-  bool is_end_of_term = *params->reading_ptr[0] == '\n';
-  bool no_follow_up = is_end_of_term && strncmp (*params->reading_ptr, "\n:", 2) != 0;
-  bool is_end_of_list = strncmp (*params->reading_ptr, "\n\n", 2) == 0 || no_follow_up;
+  bool is_end_of_term = params->token->kind == TOKEN_NEWLINE;
+  bool no_follow_up = is_end_of_term && !starts_line_with (params->token, TOKEN_COLON, 1);
+  bool is_end_of_list = starts_line_with (params->token, TOKEN_NEWLINE, 1) || no_follow_up;
 
   if (is_end_of_list || is_end_of_term)
     {
@@ -96,7 +127,7 @@ definition_list_term_block_end_parser (parsing_block_end_params_t *params)
 static bool
 definition_list_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0)
+  if (ends_list (params->token))
     return true;
 
   return false;
@@ -108,8 +139,8 @@ definition_list_block_end_parser (parsing_block_end_params_t *params)
 static bool
 definition_list_definition_block_end_parser (parsing_block_end_params_t *params)
 {
-  bool is_end_of_list = strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
-  bool is_end_of_definition = strncmp (*params->reading_ptr, "\n:", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
+  bool is_end_of_list = ends_list (params->token);
+  bool is_end_of_definition = starts_line_with (params->token, TOKEN_COLON, 1) || starts_section_line (params->token);
 
   if (is_end_of_list || is_end_of_definition)
     {
@@ -128,7 +159,7 @@ definition_list_definition_block_end_parser (parsing_block_end_params_t *params)
 static bool
 gallery_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "</gallery>", 10) == 0)
+  if (params->token->kind == TOKEN_CLOSE_GALLERY)
     {
       *params->reading_ptr += 10;
       return true;
@@ -143,20 +174,17 @@ gallery_block_end_parser (parsing_block_end_params_t *params)
 static bool
 gallery_item_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n", 1) == 0 || strncmp (*params->reading_ptr, "</gallery>", 10) == 0)
+  if (params->token->kind == TOKEN_NEWLINE || params->token->kind == TOKEN_CLOSE_GALLERY)
     {
-      if (strncmp (*params->reading_ptr, "\n", 1) == 0 && strncmp (*params->reading_ptr, "\n</gallery>", 11) != 0)
+      if (params->token->kind == TOKEN_NEWLINE && !starts_line_with (params->token, TOKEN_CLOSE_GALLERY, 1))
         {
           // not ideal to put it here, but since those list items are not prepended
           // by any markup, it makes things easier than to handle it in parse_block_start().
-
-          *params->next_item = xalloc (sizeof **params->next_item);
-          (*params->next_item)->type = NODE_GALLERY_ITEM;
-          (*params->next_item)->is_block_level = true;
-          append_child (params->current_node->parent, *params->next_item);
+          // It's created once text of the current item is flushed, to keep nodes in order.
+          *params->opens_next_item = true;
         }
 
-      if (strncmp (*params->reading_ptr, "</gallery>", 10) == 0)
+      if (params->token->kind == TOKEN_CLOSE_GALLERY)
         *params->reading_ptr += 10;
 
       return true;
@@ -171,12 +199,10 @@ gallery_item_block_end_parser (parsing_block_end_params_t *params)
 static bool
 heading_block_end_parser (parsing_block_end_params_t *params)
 {
-  char closing_tag[10] = {0};
-  for (size_t i = 0; i < params->block->subtype && i < 6; i++)
-    closing_tag[i] = '=';
-  closing_tag[strlen (closing_tag)] = '='; // because h1 is "==", we need one more.
+  size_t closing_len = params->block->subtype < 6 ? params->block->subtype : 6;
+  closing_len++; // because h1 is "==", we need one more.
 
-  if (strncmp (*params->reading_ptr, closing_tag, strlen (closing_tag)) == 0)
+  if (params->token->kind == TOKEN_EQUALS && params->token->len >= closing_len)
     {
       while (*params->reading_ptr[0] != '\n' && *params->reading_ptr[0] != 0)
         (*params->reading_ptr)++;
@@ -196,7 +222,7 @@ heading_block_end_parser (parsing_block_end_params_t *params)
 static bool
 horizontal_rule_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (*params->reading_ptr[0] == '\n' || *params->reading_ptr[0] == 0)
+  if (params->token->kind == TOKEN_NEWLINE || params->token->kind == TOKEN_END)
     return true;
 
   return false;
@@ -208,7 +234,7 @@ horizontal_rule_block_end_parser (parsing_block_end_params_t *params)
 static bool
 numbered_list_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0)
+  if (ends_list (params->token))
     return true;
 
   return false;
@@ -220,8 +246,8 @@ numbered_list_block_end_parser (parsing_block_end_params_t *params)
 static bool
 numbered_list_item_block_end_parser (parsing_block_end_params_t *params)
 {
-  bool is_end_of_list = strncmp (*params->reading_ptr, "\n\n", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
-  bool is_end_of_item = strncmp (*params->reading_ptr, "\n#", 2) == 0 || strncmp (*params->reading_ptr, "\n----", 5) == 0 || strncmp (*params->reading_ptr, "\n==", 3) == 0;
+  bool is_end_of_list = ends_list (params->token);
+  bool is_end_of_item = starts_line_with (params->token, TOKEN_HASH, 1) || starts_section_line (params->token);
 
   if (is_end_of_list || is_end_of_item)
     {
@@ -238,9 +264,9 @@ numbered_list_item_block_end_parser (parsing_block_end_params_t *params)
  * Parsing block end for NODE_PREFORMATTED_TEXT.
  */
 static bool
-preformated_text_block_end_parser (parsing_block_end_params_t *params)
+preformatted_text_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n", 1) == 0 && strncmp (*params->reading_ptr, "\n ", 2) != 0)
+  if (params->token->kind == TOKEN_NEWLINE && !starts_line_with (params->token, TOKEN_SPACE, 1))
     return true;
 
   return false;
@@ -252,7 +278,7 @@ preformated_text_block_end_parser (parsing_block_end_params_t *params)
 static bool
 table_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "|}", 2) == 0)
+  if (params->token->kind == TOKEN_CLOSE_TABLE)
     {
       *params->reading_ptr += 2;
       return true;
@@ -267,7 +293,7 @@ table_block_end_parser (parsing_block_end_params_t *params)
 static bool
 table_caption_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n", 1) == 0)
+  if (params->token->kind == TOKEN_NEWLINE)
     return true;
 
   return false;
@@ -279,71 +305,58 @@ table_caption_block_end_parser (parsing_block_end_params_t *params)
 static bool
 table_row_block_end_parser (parsing_block_end_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "\n|-", 3) == 0 || strncmp (*params->reading_ptr, "|}", 2) == 0)
+  if (starts_line_with (params->token, TOKEN_TABLE_ROW, 1) || params->token->kind == TOKEN_CLOSE_TABLE)
     return true;
 
   return false;
 }
 
-#define PARAGRAPH_ENDING_STRINGS_LEN 7
-const char *paragraph_ending_strings[PARAGRAPH_ENDING_STRINGS_LEN] = { "\n\n", "\n----", "\n==", "\n*", "\n#", "\n:", "\n;"};
-
 /*
  * Parsing block end for NODE_PARAGRAPH.
  */
 static bool
 paragraph_block_end_parser (parsing_block_end_params_t *params)
 {
-  for (size_t i = 0; i < PARAGRAPH_ENDING_STRINGS_LEN; i++)
-    {
-      const char *terminator = paragraph_ending_strings[i];
-      if (strncmp (*params->reading_ptr, terminator, strlen (terminator)) == 0)
-        return true;
-    }
+  token_t *token = params->token;
+  if (ends_list (token) || starts_line_with (token, TOKEN_ASTERISK, 1) || starts_line_with (token, TOKEN_HASH, 1) || starts_line_with (token, TOKEN_COLON, 1) || starts_line_with (token, TOKEN_SEMICOLON, 1))
+    return true;
 
-  if (is_inline_block_template (*params->reading_ptr))
+  if (is_inline_block_template (params->state))
     return true;
 
   return false;
 }
 
-parser_def_t block_end_parsers[BLOCK_LEVEL_NODES_COUNT] = {
-  { .type = NODE_BLOCKLEVEL_TEMPLATE, .handler = template_block_end_parser },
-  { .type = NODE_BULLET_LIST, .handler = bullet_list_block_end_parser },
-  { .type = NODE_BULLET_LIST_ITEM, .handler = bullet_list_item_block_end_parser },
-  { .type = NODE_DEFINITION_LIST_TERM, .handler = definition_list_term_block_end_parser },
-  { .type = NODE_DEFINITION_LIST, .handler = definition_list_block_end_parser },
-  { .type = NODE_DEFINITION_LIST_DEFINITION, .handler = definition_list_definition_block_end_parser },
-  { .type = NODE_GALLERY, .handler = gallery_block_end_parser },
-  { .type = NODE_GALLERY_ITEM, .handler = gallery_item_block_end_parser },
-  { .type = NODE_HEADING, .handler = heading_block_end_parser },
-  { .type = NODE_HORIZONTAL_RULE, .handler = horizontal_rule_block_end_parser },
-  { .type = NODE_NUMBERED_LIST, .handler = numbered_list_block_end_parser },
-  { .type = NODE_NUMBERED_LIST_ITEM, .handler = numbered_list_item_block_end_parser },
-  { .type = NODE_PREFORMATTED_TEXT, .handler = preformated_text_block_end_parser },
-  { .type = NODE_TABLE, .handler = table_block_end_parser },
-  { .type = NODE_TABLE_CAPTION, .handler = table_caption_block_end_parser },
-  { .type = NODE_TABLE_ROW, .handler = table_row_block_end_parser },
-  { .type = NODE_PARAGRAPH, .handler = paragraph_block_end_parser },
+/*
+ * Indexed by node type, with the handler of each type of BLOCK_LEVEL_NODE_TYPES.
+ */
+#define BLOCK_END_PARSER(node_type, name) [node_type] = { .type = node_type, .handler = name##_block_end_parser },
+static const parser_def_t block_end_parsers[] = {
+  BLOCK_LEVEL_NODE_TYPES (BLOCK_END_PARSER)
 };
 
+_Static_assert (sizeof block_end_parsers / sizeof *block_end_parsers == BLOCK_LEVEL_NODES_COUNT, "block_end_parsers must have one entry per node type.");
+
 /*
  * Parse if a mediawiki block has ended.
  *
  */
 int
-parse_block_end (node_t **current_node, char **reading_ptr, char *buffer, char **buffer_ptr)
+parse_block_end (parser_state_t *state)
 {
+  tree_t *tree = state->tree;
+  node_t **current_node = &state->current_node;
+  char **reading_ptr = &state->reading_ptr;
+  text_buffer_t *text = &state->text;
+
   while (true)
     {
-      if ((*current_node)->is_block_level && (*current_node)->type == NODE_ROOT)
+      if (((*current_node)->flags & NODE_BLOCK_LEVEL) && (*current_node)->type == NODE_ROOT)
         return 0;
 
-      node_t *block = *current_node;
-      node_t *next_item = NULL;
+      node_t *block = current_block (state);
+      bool opens_next_item = false;
       bool close_parent_too = false;
-      while (block && !block->is_block_level)
-        block = block->parent;
 
       if (!block)
         {
@@ -351,53 +364,62 @@ parse_block_end (node_t **current_node, char **reading_ptr, char *buffer, char *
           return 1;
         }
 
-      bool found = false;
-      for (size_t i = 0; i < BLOCK_LEVEL_NODES_COUNT; i++)
+      if (block->type >= BLOCK_LEVEL_NODES_COUNT || !block_end_parsers[block->type].handler)
         {
-          parser_def_t def = block_end_parsers[i];
-          if (def.type == block->type)
-            {
-              found = true;
-              parsing_block_end_params_t params = {
-                .current_node = *current_node,
-                .block = block,
-                .next_item = &next_item,
-                .reading_ptr = reading_ptr,
-                .close_parent_too = &close_parent_too,
-              };
-
-              bool matched = def.handler (&params);
-              if (!matched)
-                return 0;
-
-              break;
-            } 
-        }
-
-      if (!found)
-        {
-          fprintf (stderr, "parse_block_end.c : parse_block_end() : unknown node type : %ld\n", (*current_node)->type);
+          fprintf (stderr, "parse_block_end.c : parse_block_end() : unknown node type : %d\n", (*current_node)->type);
           return 1;
         }
 
+      parsing_block_end_params_t params = {
+        .state = state,
+        .current_node = *current_node,
+        .block = block,
+        .opens_next_item = &opens_next_item,
+        .reading_ptr = reading_ptr,
+        .token = current_token (state),
+        .close_parent_too = &close_parent_too,
+      };
+
+      bool matched = block_end_parsers[block->type].handler (&params);
+      if (!matched)
+        return 0;
+
       while (*reading_ptr[0] == '\n')
         (*reading_ptr)++;
 
-      int err = flush_text_buffer (*current_node, buffer, buffer_ptr);
+      int err = flush_text_buffer (tree, *current_node, text);
       if (err)
         {
           fprintf (stderr, "parse_block_end.c : parse_block_end() : error while append flushing text buffer.\n");
           return err;
         }
 
-      if (next_item)
-        *current_node = next_item;
+      if (opens_next_item)
+        {
+          node_t *next_item = tree_new_node (tree);
+          next_item->type = NODE_GALLERY_ITEM;
+          next_item->flags = NODE_BLOCK_LEVEL;
+          append_child (tree, tree_node (tree, (*current_node)->parent), next_item);
+
+          // the next item is a sibling of the current node, the block is only left if it's that node.
+          if (*current_node == block)
+            pop_block (state);
+
+          *current_node = next_item;
+          push_block (state, next_item);
+        }
       else
         {
-          *current_node = block->parent;
+          *current_node = tree_node (tree, block->parent);
+          pop_block (state);
 
           if (close_parent_too)
-            *current_node = (*current_node)->parent;
+            {
+              if ((*current_node)->flags & NODE_BLOCK_LEVEL)
+                pop_block (state);
+
+              *current_node = tree_node (tree, (*current_node)->parent);
+            }
         }
     }
 
@@ -7,8 +7,10 @@
 #include "utils.h"
 
 typedef struct {
+  tree_t *tree;
   node_t *current_node;
   char **reading_ptr;
+  token_t *token;
   node_t *new_node;
   int *new_child_node;
   size_t *list_item_markup_len;
@@ -20,13 +22,15 @@ typedef struct {
   parsing_block_start_t *handler;
 } parser_def_t;
 
+#define BLOCK_START_PARSERS_PER_TOKEN 2
+
 /*
  * Parsing start of NODE_BLOCKLEVEL_TEMPLATE.
  */
 static bool
 template_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "{{", 2) == 0)
+  if (params->token->kind == TOKEN_OPEN_TEMPLATE)
     {
       params->new_node->type = NODE_BLOCKLEVEL_TEMPLATE;
       *params->reading_ptr += 2;
@@ -42,12 +46,12 @@ template_block_start_parser (parsing_block_start_params_t *params)
 static bool
 bullet_list_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "*", 1) == 0)
+  if (params->token->kind == TOKEN_ASTERISK)
     {
       if (params->current_node->type != NODE_BULLET_LIST)
         {
           params->new_node->type = NODE_BULLET_LIST;
-          params->new_node->can_have_block_children = true;
+          params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
           *params->new_child_node = NODE_BULLET_LIST_ITEM;
           *params->list_item_markup_len = 1;
 
@@ -64,7 +68,7 @@ bullet_list_block_start_parser (parsing_block_start_params_t *params)
 static bool
 bullet_list_item_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "*", 1) == 0)
+  if (params->token->kind == TOKEN_ASTERISK)
     {
       if (params->current_node->type == NODE_BULLET_LIST)
         {
@@ -73,7 +77,10 @@ bullet_list_item_block_start_parser (parsing_block_start_params_t *params)
           while (*params->reading_ptr[0] == '*')
             {
               (*params->reading_ptr)++;
-              params->new_node->subtype++;
+
+              // deeper levels are flattened to what `subtype` can hold.
+              if (params->new_node->subtype < UINT8_MAX)
+                params->new_node->subtype++;
             }
 
           return true;
@@ -89,10 +96,10 @@ bullet_list_item_block_start_parser (parsing_block_start_params_t *params)
 static bool
 definition_list_term_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, ";", 1) == 0)
+  if (params->token->kind == TOKEN_SEMICOLON)
     {
       params->new_node->type = NODE_DEFINITION_LIST;
-      params->new_node->can_have_block_children = true;
+      params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
       *params->new_child_node = NODE_DEFINITION_LIST_TERM;
       *params->list_item_markup_len = 1;
       return true;
@@ -107,12 +114,12 @@ definition_list_term_block_start_parser (parsing_block_start_params_t *params)
 static bool
 definition_list_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, ":", 1) == 0)
+  if (params->token->kind == TOKEN_COLON)
     {
       if (params->current_node->type != NODE_DEFINITION_LIST)
         {
           params->new_node->type = NODE_DEFINITION_LIST;
-          params->new_node->can_have_block_children = true;
+          params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
           *params->new_child_node = NODE_DEFINITION_LIST_DEFINITION;
           *params->list_item_markup_len = 1;
           return true;
@@ -128,7 +135,7 @@ definition_list_block_start_parser (parsing_block_start_params_t *params)
 static bool
 definition_list_definition_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, ":", 1) == 0)
+  if (params->token->kind == TOKEN_COLON)
     {
       if (params->current_node->type == NODE_DEFINITION_LIST)
         {
@@ -147,10 +154,10 @@ definition_list_definition_block_start_parser (parsing_block_start_params_t *par
 static bool
 gallery_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "<gallery>", 9) == 0)
+  if (params->token->kind == TOKEN_OPEN_GALLERY)
     {
       params->new_node->type = NODE_GALLERY;
-      params->new_node->can_have_block_children = true;
+      params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
       *params->new_child_node = NODE_GALLERY_ITEM;
       *params->reading_ptr += 9;
       *params->list_item_markup_len = 0;
@@ -164,26 +171,13 @@ gallery_block_start_parser (parsing_block_start_params_t *params)
   return false;
 }
 
-/*
- * Parsing start of NODE_GALLERY_ITEM.
- *
- * Noop, as creating a new NODE_GALLERY_ITEM is done either
- * in gallery_block_start_parser() or in gallery_item_block_end_parser().
- */
-static bool
-gallery_item_block_start_parser (parsing_block_start_params_t *params)
-{
-  (void) params;
-  return false;
-}
-
 /*
  * Parsing start of NODE_HEADING.
  */
 static bool
 heading_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "==", 2) == 0)
+  if (params->token->kind == TOKEN_EQUALS && params->token->len >= 2)
     {
       params->new_node->type = NODE_HEADING;
       params->new_node->subtype = 1;
@@ -206,7 +200,7 @@ heading_block_start_parser (parsing_block_start_params_t *params)
 static bool
 horizontal_rule_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "----", 4) == 0)
+  if (params->token->kind == TOKEN_DASHES && params->token->len >= 4)
     {
       params->new_node->type = NODE_HORIZONTAL_RULE;
       *params->reading_ptr += 4;
@@ -222,12 +216,12 @@ horizontal_rule_block_start_parser (parsing_block_start_params_t *params)
 static bool
 numbered_list_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "#", 1) == 0)
+  if (params->token->kind == TOKEN_HASH)
     {
       if ((params->current_node)->type != NODE_NUMBERED_LIST)
         {
           params->new_node->type = NODE_NUMBERED_LIST;
-          params->new_node->can_have_block_children = true;
+          params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
           *params->new_child_node = NODE_NUMBERED_LIST_ITEM;
           *params->list_item_markup_len = 1;
 
@@ -244,7 +238,7 @@ numbered_list_block_start_parser (parsing_block_start_params_t *params)
 static bool
 numbered_list_item_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "#", 1) == 0)
+  if (params->token->kind == TOKEN_HASH)
     {
       if ((params->current_node)->type == NODE_NUMBERED_LIST)
         {
@@ -253,7 +247,10 @@ numbered_list_item_block_start_parser (parsing_block_start_params_t *params)
           while (*params->reading_ptr[0] == '#')
             {
               (*params->reading_ptr)++;
-              params->new_node->subtype++;
+
+              // deeper levels are flattened to what `subtype` can hold.
+              if (params->new_node->subtype < UINT8_MAX)
+                params->new_node->subtype++;
             }
 
           return true;
@@ -269,7 +266,7 @@ numbered_list_item_block_start_parser (parsing_block_start_params_t *params)
 static bool
 preformated_text_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, " ", 1) == 0)
+  if (params->token->kind == TOKEN_SPACE)
     {
       params->new_node->type = NODE_PREFORMATTED_TEXT;
       (*params->reading_ptr)++;
@@ -286,26 +283,23 @@ preformated_text_block_start_parser (parsing_block_start_params_t *params)
 static bool
 table_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "{|", 2) == 0)
+  if (params->token->kind == TOKEN_OPEN_TABLE)
     {
       params->new_node->type = NODE_TABLE;
-      params->new_node->can_have_block_children = true;
+      params->new_node->flags |= NODE_CAN_HAVE_BLOCK_CHILDREN;
       *params->reading_ptr += 2;
       while (*params->reading_ptr[0] == ' ')
         (*params->reading_ptr)++;
 
-      char buffer[BUFSIZ] = {0};
-      size_t i = 0;
-      while (i < BUFSIZ - 1 && *params->reading_ptr[0] != '\n' && *params->reading_ptr[0] != 0 && strncmp (*params->reading_ptr, "|}", 2) != 0)
-        {
-          buffer[i++] = *params->reading_ptr[0];
-          (*params->reading_ptr)++;
-        }
+      text_buffer_t attributes = { .start = *params->reading_ptr, .end = *params->reading_ptr };
+      while (attributes.end - attributes.start < BUFSIZ - 1 && attributes.end[0] != '\n' && attributes.end[0] != 0 && lex (attributes.end).kind != TOKEN_CLOSE_TABLE)
+        attributes.end++;
 
+      *params->reading_ptr = attributes.end;
       while (*params->reading_ptr[0] == '\n')
         (*params->reading_ptr)++;
 
-      flush_text_buffer (params->new_node, buffer, NULL);
+      flush_text_buffer (params->tree, params->new_node, &attributes);
 
       return true;
     }
@@ -319,7 +313,7 @@ table_block_start_parser (parsing_block_start_params_t *params)
 static bool
 table_caption_block_start_parser (parsing_block_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "|+", 2) == 0)
+  if (params->token->kind == TOKEN_TABLE_CAPTION)
     {
       params->new_node->type = NODE_TABLE_CAPTION;
       *params->reading_ptr += 2;
@@ -339,15 +333,16 @@ static bool
 table_row_block_start_parser (parsing_block_start_params_t *params)
 {
   // the first line of a table is assumed to be a row if not specified.
-  bool needs_row = params->current_node->parent && params->current_node->parent->type == NODE_TABLE && params->current_node->parent->children_len == 0 && strncmp (*params->reading_ptr, "|+", 2) != 0;
+  node_t *parent = tree_node (params->tree, params->current_node->parent);
+  bool needs_row = parent && parent->type == NODE_TABLE && !parent->first_child && params->token->kind != TOKEN_TABLE_CAPTION;
 
-  if (needs_row && (strncmp (*params->reading_ptr, "| ", 2) == 0 || strncmp (*params->reading_ptr, "! ", 2) == 0))
+  if (needs_row && (params->token->kind == TOKEN_PIPE || params->token->kind == TOKEN_BANG) && params->token->next_kind == TOKEN_SPACE)
     {
       params->new_node->type = NODE_TABLE_ROW;
       return true;
     }
 
-  if (strncmp (*params->reading_ptr, "|-", 2) == 0)
+  if (params->token->kind == TOKEN_TABLE_ROW)
     {
       params->new_node->type = NODE_TABLE_ROW;
       *params->reading_ptr += 2;
@@ -372,39 +367,79 @@ paragraph_block_start_parser (parsing_block_start_params_t *params)
   return true;
 }
 
-parser_def_t block_start_parsers[BLOCK_LEVEL_NODES_COUNT] = {
-  { .type = NODE_BLOCKLEVEL_TEMPLATE, .handler = template_block_start_parser },
-  { .type = NODE_BULLET_LIST, .handler = bullet_list_block_start_parser },
-  { .type = NODE_BULLET_LIST_ITEM, .handler = bullet_list_item_block_start_parser },
-  { .type = NODE_DEFINITION_LIST_TERM, .handler = definition_list_term_block_start_parser },
-  { .type = NODE_DEFINITION_LIST, .handler = definition_list_block_start_parser },
-  { .type = NODE_DEFINITION_LIST_DEFINITION, .handler = definition_list_definition_block_start_parser },
-  { .type = NODE_GALLERY, .handler = gallery_block_start_parser },
-  { .type = NODE_GALLERY_ITEM, .handler = gallery_item_block_start_parser },
-  { .type = NODE_HEADING, .handler = heading_block_start_parser },
-  { .type = NODE_HORIZONTAL_RULE, .handler = horizontal_rule_block_start_parser },
-  { .type = NODE_NUMBERED_LIST, .handler = numbered_list_block_start_parser },
-  { .type = NODE_NUMBERED_LIST_ITEM, .handler = numbered_list_item_block_start_parser },
-  { .type = NODE_PREFORMATTED_TEXT, .handler = preformated_text_block_start_parser },
-  { .type = NODE_TABLE, .handler = table_block_start_parser },
-  { .type = NODE_TABLE_CAPTION, .handler = table_caption_block_start_parser },
-  { .type = NODE_TABLE_ROW, .handler = table_row_block_start_parser },
-  { .type = NODE_PARAGRAPH, .handler = paragraph_block_start_parser },
+/*
+ * Parsers which can match a given token, in the order they must be
+ * tried: don't sort them. When none matches, or there is none for
+ * that token, it's a paragraph.
+ *
+ * NODE_GALLERY_ITEM is not there, as it's created either in
+ * gallery_block_start_parser() or in gallery_item_block_end_parser().
+ */
+static const parser_def_t block_start_parsers[TOKENS_COUNT][BLOCK_START_PARSERS_PER_TOKEN + 1] = {
+  [TOKEN_OPEN_TEMPLATE] = {
+    { .type = NODE_BLOCKLEVEL_TEMPLATE, .handler = template_block_start_parser },
+  },
+  [TOKEN_OPEN_TABLE] = {
+    { .type = NODE_TABLE, .handler = table_block_start_parser },
+  },
+  [TOKEN_ASTERISK] = {
+    { .type = NODE_BULLET_LIST, .handler = bullet_list_block_start_parser },
+    { .type = NODE_BULLET_LIST_ITEM, .handler = bullet_list_item_block_start_parser },
+  },
+  [TOKEN_SEMICOLON] = {
+    { .type = NODE_DEFINITION_LIST_TERM, .handler = definition_list_term_block_start_parser },
+  },
+  [TOKEN_COLON] = {
+    { .type = NODE_DEFINITION_LIST, .handler = definition_list_block_start_parser },
+    { .type = NODE_DEFINITION_LIST_DEFINITION, .handler = definition_list_definition_block_start_parser },
+  },
+  [TOKEN_OPEN_GALLERY] = {
+    { .type = NODE_GALLERY, .handler = gallery_block_start_parser },
+  },
+  [TOKEN_EQUALS] = {
+    { .type = NODE_HEADING, .handler = heading_block_start_parser },
+  },
+  [TOKEN_DASHES] = {
+    { .type = NODE_HORIZONTAL_RULE, .handler = horizontal_rule_block_start_parser },
+  },
+  [TOKEN_HASH] = {
+    { .type = NODE_NUMBERED_LIST, .handler = numbered_list_block_start_parser },
+    { .type = NODE_NUMBERED_LIST_ITEM, .handler = numbered_list_item_block_start_parser },
+  },
+  [TOKEN_SPACE] = {
+    { .type = NODE_PREFORMATTED_TEXT, .handler = preformated_text_block_start_parser },
+  },
+  [TOKEN_TABLE_CAPTION] = {
+    { .type = NODE_TABLE_CAPTION, .handler = table_caption_block_start_parser },
+  },
+  [TOKEN_TABLE_ROW] = {
+    { .type = NODE_TABLE_ROW, .handler = table_row_block_start_parser },
+  },
+  [TOKEN_PIPE] = {
+    { .type = NODE_TABLE_ROW, .handler = table_row_block_start_parser },
+  },
+  [TOKEN_BANG] = {
+    { .type = NODE_TABLE_ROW, .handler = table_row_block_start_parser },
+  },
 };
 
 /*
  * Parse if a mediawiki block has started.
  */
 int
-parse_block_start (node_t **current_node, char **reading_ptr)
+parse_block_start (parser_state_t *state)
 {
+  tree_t *tree = state->tree;
+  node_t **current_node = &state->current_node;
+  char **reading_ptr = &state->reading_ptr;
   int err = 0;
 
   /*
    * if there is not at least a markup character and a text character,
-   * this can't be anything we're interested in.
+   * this can't be anything we're interested in. A NUL byte in the
+   * input ends markup like the end of input does.
    */
-  if (strlen (*reading_ptr) < 2)
+  if (REMAINING_LEN (state) < 2 || !(*reading_ptr)[0] || !(*reading_ptr)[1])
     return err;
 
   /*
@@ -412,54 +447,58 @@ parse_block_start (node_t **current_node, char **reading_ptr)
    * in the middle of a paragraph, and still display it as a block
    * level element.
    */
-  if (is_inline_block_template (*reading_ptr))
+  if (is_inline_block_template (state))
     {
-      node_t *new_node = xalloc (sizeof *new_node);
-      new_node->is_block_level = true;
+      node_t *new_node = tree_new_node (tree);
+      new_node->flags = NODE_BLOCK_LEVEL;
       new_node->type = NODE_BLOCKLEVEL_TEMPLATE;
       *reading_ptr += 2;
-      append_child (*current_node, new_node);
+      append_child (tree, *current_node, new_node);
       *current_node = new_node;
+      push_block (state, new_node);
       return err;
     }
 
-  if (!(*current_node)->can_have_block_children)
+  if (!((*current_node)->flags & NODE_CAN_HAVE_BLOCK_CHILDREN))
     return err;
 
-  node_t *new_node = xalloc (sizeof *new_node);
+  node_t *new_node = tree_new_node (tree);
   int new_child_node = 0;
   size_t list_item_markup_len = 0;
 
-  for (size_t i = 0; i < BLOCK_LEVEL_NODES_COUNT; i++)
-    {
-      parser_def_t def = block_start_parsers[i];
-
-      parsing_block_start_params_t params = {
-        .current_node = *current_node,
-        .reading_ptr = reading_ptr,
-        .new_node = new_node,
-        .new_child_node = &new_child_node,
-        .list_item_markup_len = &list_item_markup_len,
-      };
-
-      bool matched = def.handler (&params);
-      if (matched)
-        break;
-    }
+  parsing_block_start_params_t params = {
+    .tree = tree,
+    .current_node = *current_node,
+    .reading_ptr = reading_ptr,
+    .token = current_token (state),
+    .new_node = new_node,
+    .new_child_node = &new_child_node,
+    .list_item_markup_len = &list_item_markup_len,
+  };
+
+  const parser_def_t *candidates = block_start_parsers[params.token->kind];
+  bool matched = false;
+  for (size_t i = 0; !matched && candidates[i].handler; i++)
+    matched = candidates[i].handler (&params);
+
+  if (!matched)
+    paragraph_block_start_parser (&params);
 
-  new_node->is_block_level = true;
-  append_child (*current_node, new_node);
+  new_node->flags |= NODE_BLOCK_LEVEL;
+  append_child (tree, *current_node, new_node);
 
   *current_node = new_node;
+  push_block (state, new_node);
 
   if (new_child_node)
     {
-      node_t *list_item = xalloc (sizeof *list_item);
+      node_t *list_item = tree_new_node (tree);
       list_item->type = new_child_node;
       list_item->subtype = 1;
-      list_item->is_block_level = true;
-      append_child (new_node, list_item);
+      list_item->flags = NODE_BLOCK_LEVEL;
+      append_child (tree, new_node, list_item);
       *current_node = list_item;
+      push_block (state, list_item);
       *reading_ptr += list_item_markup_len;
     }
 
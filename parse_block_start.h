@@ -3,6 +3,6 @@
 
 #include "parser.h"
 
-int parse_block_start (node_t **current_node, char **reading_ptr);
+int parse_block_start (parser_state_t *state);
 
 #endif
@@ -5,7 +5,7 @@
 #include "parser.h"
 #include "utils.h"
 
-typedef bool (parsing_inline_end_t) (char  **reading_ptr);
+typedef bool (parsing_inline_end_t) (token_t *token, char **reading_ptr);
 typedef struct {
   size_t type;
   parsing_inline_end_t *handler;
@@ -15,9 +15,9 @@ typedef struct {
  * Parsing inline end for NODE_EMPHASIS.
  */
 static bool
-emphasis_inline_end_parser (char **reading_ptr)
+emphasis_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "''", 2) == 0)
+  if (token->kind == TOKEN_QUOTES && token->len >= 2)
     {
       *reading_ptr += 2;
       return true;
@@ -30,9 +30,9 @@ emphasis_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_EXTERNAL_LINK.
  */
 static bool
-external_link_inline_end_parser (char **reading_ptr)
+external_link_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "]", 1) == 0)
+  if (token->kind == TOKEN_CLOSE_BRACKET || token->kind == TOKEN_CLOSE_LINK)
     {
       *reading_ptr += 1;
       return true;
@@ -45,9 +45,9 @@ external_link_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_INLINE_TEMPLATE.
  */
 static bool
-template_inline_end_parser (char **reading_ptr)
+template_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "}}", 2) == 0)
+  if (token->kind == TOKEN_CLOSE_TEMPLATE)
     {
       *reading_ptr += 2;
       return true;
@@ -60,9 +60,9 @@ template_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_INTERNAL_LINK.
  */
 static bool
-internal_link_inline_end_parser (char **reading_ptr)
+internal_link_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "]]", 2) == 0)
+  if (token->kind == TOKEN_CLOSE_LINK)
     {
       *reading_ptr += 2;
       return true;
@@ -75,9 +75,9 @@ internal_link_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_MEDIA.
  */
 static bool
-media_inline_end_parser (char **reading_ptr)
+media_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "]]", 2) == 0)
+  if (token->kind == TOKEN_CLOSE_LINK)
     {
       *reading_ptr += 2;
       return true;
@@ -90,9 +90,9 @@ media_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_STRONG.
  */
 static bool
-strong_inline_end_parser (char **reading_ptr)
+strong_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "'''", 3) == 0)
+  if (token->kind == TOKEN_QUOTES && token->len >= 3)
     {
       *reading_ptr += 3;
       return true;
@@ -105,9 +105,9 @@ strong_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_STRONG_AND_EMPHASIS.
  */
 static bool
-strong_and_emphasis_inline_end_parser (char **reading_ptr)
+strong_and_emphasis_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "'''''", 5) == 0)
+  if (token->kind == TOKEN_QUOTES && token->len >= 5)
     {
       *reading_ptr += 5;
       return true;
@@ -120,15 +120,15 @@ strong_and_emphasis_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_TABLE_CELL.
  */
 static bool
-table_cell_inline_end_parser (char **reading_ptr)
+table_cell_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "||", 2) == 0)
+  if (token->kind == TOKEN_CELL_SEPARATOR)
     {
       (*reading_ptr)++; // eating a single pipe on purpose, to allow matching start of next cell
       return true;
     }
 
-  if (strncmp (*reading_ptr, "\n", 1) == 0)
+  if (token->kind == TOKEN_NEWLINE)
     {
       // not eating anything, we'll leave to the block level parent to decide if it's closed.
       return true;
@@ -141,15 +141,15 @@ table_cell_inline_end_parser (char **reading_ptr)
  * Parsing inline end for NODE_TABLE_HEADER.
  */
 static bool
-table_header_inline_end_parser (char **reading_ptr)
+table_header_inline_end_parser (token_t *token, char **reading_ptr)
 {
-  if (strncmp (*reading_ptr, "!!", 2) == 0)
+  if (token->kind == TOKEN_HEADER_SEPARATOR)
     {
       (*reading_ptr)++; // eating a single pipe on purpose, to allow matching start of next cell
       return true;
     }
 
-  if (strncmp (*reading_ptr, "\n", 1) == 0)
+  if (token->kind == TOKEN_NEWLINE)
     {
       // not eating anything, we'll leave to the block level parent to decide if it's closed.
       return true;
@@ -164,70 +164,83 @@ table_header_inline_end_parser (char **reading_ptr)
  * This is a noop, as this is the default behavior.
  */
 static bool
-text_inline_end_parser (char **reading_ptr)
+text_inline_end_parser (token_t *token, char **reading_ptr)
 {
+  (void) token;
   (void) reading_ptr;
   return false;
 }
 
-parser_def_t inline_end_parsers[INLINE_NODES_COUNT] = {
-  { .type = NODE_EMPHASIS, .handler = emphasis_inline_end_parser },
-  { .type = NODE_EXTERNAL_LINK, .handler = external_link_inline_end_parser },
-  { .type = NODE_INLINE_TEMPLATE, .handler = template_inline_end_parser },
-  { .type = NODE_INTERNAL_LINK, .handler = internal_link_inline_end_parser },
-  { .type = NODE_MEDIA, .handler = media_inline_end_parser },
-  { .type = NODE_STRONG, .handler = strong_inline_end_parser },
-  { .type = NODE_STRONG_AND_EMPHASIS, .handler = strong_and_emphasis_inline_end_parser },
-  { .type = NODE_TABLE_CELL, .handler = table_cell_inline_end_parser },
-  { .type = NODE_TABLE_HEADER, .handler = table_header_inline_end_parser },
-  { .type = NODE_TEXT, .handler = text_inline_end_parser },
+/*
+ * Indexed by node type, with the handler of each type of INLINE_NODE_TYPES.
+ */
+#define INLINE_END_PARSER(node_type, name) [node_type] = { .type = node_type, .handler = name##_inline_end_parser },
+static const parser_def_t inline_end_parsers[] = {
+  INLINE_NODE_TYPES (INLINE_END_PARSER)
 };
 
+_Static_assert (sizeof inline_end_parsers / sizeof *inline_end_parsers == INLINE_NODES_COUNT, "inline_end_parsers must have one entry per node type.");
+
+/*
+ * Forget the last child of `parent`.
+ */
+static void
+remove_last_child (tree_t *tree, node_t *parent)
+{
+  node_t *previous = tree_node (tree, tree_node (tree, parent->last_child)->previous_sibling);
+
+  if (previous)
+    previous->next_sibling = NO_NODE;
+  else
+    parent->first_child = NO_NODE;
+
+  parent->last_child = previous ? previous->id : NO_NODE;
+}
+
 /*
  * Parse mediawiki inline tags closing.
  */
 int
-parse_inline_end (node_t **current_node, char **reading_ptr, char *buffer, char **buffer_ptr)
+parse_inline_end (parser_state_t *state)
 {
+  tree_t *tree = state->tree;
+  node_t **current_node = &state->current_node;
+  char **reading_ptr = &state->reading_ptr;
+  text_buffer_t *text = &state->text;
   int err = 0;
 
   while (true)
     {
-      if (strlen (*reading_ptr) < 2)
+      // closing tags can be a single character, down to the last one of input.
+      if (REMAINING_LEN (state) < 1 || !(*reading_ptr)[0])
         return 0;
 
-      if ((*current_node)->is_block_level)
+      if ((*current_node)->flags & NODE_BLOCK_LEVEL)
         return 0;
 
-      for (size_t i = 0; i < INLINE_NODES_COUNT; i++)
+      size_t type = (*current_node)->type;
+      if (type < INLINE_NODES_COUNT && inline_end_parsers[type].handler)
         {
-          parser_def_t def = inline_end_parsers[i];
-          if (def.type == (*current_node)->type)
-            {
-              bool matched = def.handler (reading_ptr);
-              if (!matched)
-                return 0;
-
-              break;
-            }
+          bool matched = inline_end_parsers[type].handler (current_token (state), reading_ptr);
+          if (!matched)
+            return 0;
         }
 
-      err = flush_text_buffer (*current_node, buffer, buffer_ptr);
+      err = flush_text_buffer (tree, *current_node, text);
       if (err)
         {
           fprintf (stderr, "parse_inline_end.c : parse_inline_end() : error while flushing text buffer.\n");
           return err;
         }
 
-      if ((*current_node)->type == NODE_TEXT && strlen ((*current_node)->text_content) == 0)
+      if ((*current_node)->type == NODE_TEXT && (*current_node)->text_len == 0)
         {
-          node_t *parent = (*current_node)->parent;
-          parent->children_len--;
-          free_node (*current_node);
+          node_t *parent = tree_node (tree, (*current_node)->parent);
+          remove_last_child (tree, parent);
           *current_node = parent;
         }
       else
-      *current_node = (*current_node)->parent;
+      *current_node = tree_node (tree, (*current_node)->parent);
     }
 
   return err;
@@ -3,6 +3,6 @@
 
 #include "parser.h"
 
-int parse_inline_end (node_t **current_node, char **reading_ptr, char *buffer, char **buffer_ptr);
+int parse_inline_end (parser_state_t *state);
 
 #endif
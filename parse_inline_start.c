@@ -6,9 +6,11 @@
 #include "utils.h"
 
 typedef struct {
+  tree_t *tree;
   node_t *current_node;
   char **reading_ptr;
-  node_t **new_node;
+  token_t *token;
+  int new_node_type;
   bool stop_parsing_inline;
 } parsing_inline_start_params_t;
 
@@ -18,6 +20,8 @@ typedef struct {
   parsing_inline_start_t *handler;
 } parser_def_t;
 
+#define INLINE_START_PARSERS_PER_TOKEN 3
+
 /*
  * Parsing start of NODE_STRONG_AND_EMPHASIS.
  */
@@ -25,10 +29,9 @@ static bool
 strong_and_emphasis_inline_start_parser (parsing_inline_start_params_t *params)
 {
   bool current_node_is_emphasis = params->current_node->type == NODE_STRONG_AND_EMPHASIS || params->current_node->type == NODE_STRONG || params->current_node->type == NODE_EMPHASIS;
-  if (strncmp (*params->reading_ptr, "'''''", 5) == 0 && !current_node_is_emphasis)
+  if (params->token->kind == TOKEN_QUOTES && params->token->len >= 5 && !current_node_is_emphasis)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_STRONG_AND_EMPHASIS;
+      params->new_node_type = NODE_STRONG_AND_EMPHASIS;
       *params->reading_ptr += 5;
       return true;
     }
@@ -43,10 +46,9 @@ static bool
 strong_inline_start_parser (parsing_inline_start_params_t *params)
 {
   bool current_node_is_emphasis = params->current_node->type == NODE_STRONG_AND_EMPHASIS || params->current_node->type == NODE_STRONG || params->current_node->type == NODE_EMPHASIS;
-  if (strncmp (*params->reading_ptr, "'''", 3) == 0 && !current_node_is_emphasis)
+  if (params->token->kind == TOKEN_QUOTES && params->token->len >= 3 && !current_node_is_emphasis)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_STRONG;
+      params->new_node_type = NODE_STRONG;
       *params->reading_ptr += 3;
       return true;
     }
@@ -62,10 +64,9 @@ emphasis_inline_start_parser (parsing_inline_start_params_t *params)
 {
   bool current_node_is_emphasis = params->current_node->type == NODE_STRONG_AND_EMPHASIS || params->current_node->type == NODE_STRONG || params->current_node->type == NODE_EMPHASIS;
 
-  if (strncmp (*params->reading_ptr, "''", 2) == 0 && !current_node_is_emphasis)
+  if (params->token->kind == TOKEN_QUOTES && params->token->len >= 2 && !current_node_is_emphasis)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_EMPHASIS;
+      params->new_node_type = NODE_EMPHASIS;
       *params->reading_ptr += 2;
       return true;
     }
@@ -79,10 +80,9 @@ emphasis_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 internal_link_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "[[", 2) == 0)
+  if (params->token->kind == TOKEN_OPEN_LINK)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_INTERNAL_LINK;
+      params->new_node_type = NODE_INTERNAL_LINK;
       *params->reading_ptr += 2;
       return true;
     }
@@ -96,10 +96,9 @@ internal_link_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 external_link_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "[", 1) == 0)
+  if (params->token->kind == TOKEN_OPEN_BRACKET)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_EXTERNAL_LINK;
+      params->new_node_type = NODE_EXTERNAL_LINK;
       *params->reading_ptr += 1;
       return true;
     }
@@ -113,10 +112,9 @@ external_link_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 template_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "{{", 2) == 0) // if we reach this point, it's not a block level template.
+  if (params->token->kind == TOKEN_OPEN_TEMPLATE) // if we reach this point, it's not a block level template.
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_INLINE_TEMPLATE;
+      params->new_node_type = NODE_INLINE_TEMPLATE;
       *params->reading_ptr += 2;
       return true;
     }
@@ -130,10 +128,9 @@ template_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 media_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if (strncmp (*params->reading_ptr, "[[File:", 7) == 0)
+  if (params->token->kind == TOKEN_OPEN_MEDIA)
     {
-      *params->new_node = xalloc (sizeof **params->new_node);
-      (*params->new_node)->type = NODE_MEDIA;
+      params->new_node_type = NODE_MEDIA;
       *params->reading_ptr += 2;
       return true;
     }
@@ -147,19 +144,18 @@ media_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 table_header_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if ((params->current_node->parent && params->current_node->parent->type == NODE_TABLE_ROW) || params->current_node->type == NODE_TABLE_ROW)
+  if ((params->current_node->parent && tree_node (params->tree, params->current_node->parent)->type == NODE_TABLE_ROW) || params->current_node->type == NODE_TABLE_ROW)
     {
       // we first need to close previous NODE_TABLE_HEADER
-      if (strncmp (*params->reading_ptr, "!!", 2) == 0)
+      if (params->token->kind == TOKEN_HEADER_SEPARATOR)
         {
           params->stop_parsing_inline = true;
           return false;
         }
 
-      if (strncmp (*params->reading_ptr, "!", 1) == 0)
+      if (params->token->kind == TOKEN_BANG)
         {
-          *params->new_node = xalloc (sizeof **params->new_node);
-          (*params->new_node)->type = NODE_TABLE_HEADER;
+          params->new_node_type = NODE_TABLE_HEADER;
           (*params->reading_ptr)++;
           while (*params->reading_ptr[0] == ' ')
             (*params->reading_ptr)++;
@@ -177,19 +173,18 @@ table_header_inline_start_parser (parsing_inline_start_params_t *params)
 static bool
 table_cell_inline_start_parser (parsing_inline_start_params_t *params)
 {
-  if ((params->current_node->parent && params->current_node->parent->type == NODE_TABLE_ROW) || params->current_node->type == NODE_TABLE_ROW)
+  if ((params->current_node->parent && tree_node (params->tree, params->current_node->parent)->type == NODE_TABLE_ROW) || params->current_node->type == NODE_TABLE_ROW)
     {
       // we first need to close previous NODE_TABLE_CELL
-      if (strncmp (*params->reading_ptr, "||", 2) == 0)
+      if (params->token->kind == TOKEN_CELL_SEPARATOR)
         {
           params->stop_parsing_inline = true;
           return false;
         }
 
-      if (strncmp (*params->reading_ptr, "|", 1) == 0)
+      if (params->token->kind == TOKEN_PIPE || params->token->kind == TOKEN_CLOSE_TABLE || params->token->kind == TOKEN_TABLE_ROW || params->token->kind == TOKEN_TABLE_CAPTION)
         {
-          *params->new_node = xalloc (sizeof **params->new_node);
-          (*params->new_node)->type = NODE_TABLE_CELL;
+          params->new_node_type = NODE_TABLE_CELL;
           (*params->reading_ptr)++;
           while (*params->reading_ptr[0] == ' ')
             (*params->reading_ptr)++;
@@ -202,59 +197,82 @@ table_cell_inline_start_parser (parsing_inline_start_params_t *params)
 }
 
 /*
- * Parsing start of NODE_TEXT.
- *
- * Noop, as it's the default node.
+ * Parsers which can match a given token, in the order they must be
+ * tried: don't sort them. When none matches, or there is none for
+ * that token, it's just text.
  */
-static bool
-text_inline_start_parser (parsing_inline_start_params_t *params)
-{
-  (void) params;
-  return false;
-}
-
-// don't sort this, as the order matters.
-parser_def_t inline_start_parsers[INLINE_NODES_COUNT] = {
-  { .type = NODE_STRONG_AND_EMPHASIS, .handler = strong_and_emphasis_inline_start_parser },
-  { .type = NODE_STRONG, .handler = strong_inline_start_parser },
-  { .type = NODE_EMPHASIS, .handler = emphasis_inline_start_parser },
-  { .type = NODE_MEDIA, .handler = media_inline_start_parser },
-  { .type = NODE_INTERNAL_LINK, .handler = internal_link_inline_start_parser },
-  { .type = NODE_EXTERNAL_LINK, .handler = external_link_inline_start_parser },
-  { .type = NODE_INLINE_TEMPLATE, .handler = template_inline_start_parser },
-  { .type = NODE_TABLE_HEADER, .handler = table_header_inline_start_parser },
-  { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
-  { .type = NODE_TEXT, .handler = text_inline_start_parser },
+static const parser_def_t inline_start_parsers[TOKENS_COUNT][INLINE_START_PARSERS_PER_TOKEN + 1] = {
+  [TOKEN_QUOTES] = {
+    { .type = NODE_STRONG_AND_EMPHASIS, .handler = strong_and_emphasis_inline_start_parser },
+    { .type = NODE_STRONG, .handler = strong_inline_start_parser },
+    { .type = NODE_EMPHASIS, .handler = emphasis_inline_start_parser },
+  },
+  [TOKEN_OPEN_MEDIA] = {
+    { .type = NODE_MEDIA, .handler = media_inline_start_parser },
+  },
+  [TOKEN_OPEN_LINK] = {
+    { .type = NODE_INTERNAL_LINK, .handler = internal_link_inline_start_parser },
+  },
+  [TOKEN_OPEN_BRACKET] = {
+    { .type = NODE_EXTERNAL_LINK, .handler = external_link_inline_start_parser },
+  },
+  [TOKEN_OPEN_TEMPLATE] = {
+    { .type = NODE_INLINE_TEMPLATE, .handler = template_inline_start_parser },
+  },
+  [TOKEN_BANG] = {
+    { .type = NODE_TABLE_HEADER, .handler = table_header_inline_start_parser },
+  },
+  [TOKEN_HEADER_SEPARATOR] = {
+    { .type = NODE_TABLE_HEADER, .handler = table_header_inline_start_parser },
+  },
+  [TOKEN_PIPE] = {
+    { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
+  },
+  [TOKEN_CELL_SEPARATOR] = {
+    { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
+  },
+  [TOKEN_CLOSE_TABLE] = {
+    { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
+  },
+  [TOKEN_TABLE_ROW] = {
+    { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
+  },
+  [TOKEN_TABLE_CAPTION] = {
+    { .type = NODE_TABLE_CELL, .handler = table_cell_inline_start_parser },
+  },
 };
 
 /*
  * Parse mediawiki inline tags opening.
  */
 int
-parse_inline_start (node_t **current_node, char **reading_ptr, char *buffer, char **buffer_ptr)
+parse_inline_start (parser_state_t *state)
 {
+  tree_t *tree = state->tree;
+  node_t **current_node = &state->current_node;
+  char **reading_ptr = &state->reading_ptr;
+  text_buffer_t *text = &state->text;
   int err = 0;
 
   while (true)
     {
       bool tag_matched = false;
-      node_t *new_node = NULL;
 
-      if (strlen (*reading_ptr) < 2)
+      if (REMAINING_LEN (state) < 2 || !(*reading_ptr)[0] || !(*reading_ptr)[1])
         break;
 
-      for (size_t i = 0; i < INLINE_NODES_COUNT; i++)
-        {
-          parser_def_t def = inline_start_parsers[i];
-
-          parsing_inline_start_params_t params = {
-            .current_node = *current_node,
-            .reading_ptr = reading_ptr,
-            .new_node = &new_node,
-            .stop_parsing_inline = false,
-          };
+      parsing_inline_start_params_t params = {
+        .tree = tree,
+        .current_node = *current_node,
+        .reading_ptr = reading_ptr,
+        .token = current_token (state),
+        .stop_parsing_inline = false,
+      };
 
-          tag_matched = def.handler (&params);
+      const parser_def_t *candidates = inline_start_parsers[params.token->kind];
+      for (size_t i = 0; candidates[i].handler; i++)
+        {
+          tag_matched = candidates[i].handler (&params);
           if (tag_matched || params.stop_parsing_inline)
             break;
         }
@@ -262,14 +280,16 @@ parse_inline_start (node_t **current_node, char **reading_ptr, char *buffer, cha
       if (!tag_matched)
         break;
 
-      err = flush_text_buffer (*current_node, buffer, buffer_ptr);
+      err = flush_text_buffer (tree, *current_node, text);
       if (err)
         {
           fprintf (stderr, "parse_inline_start.c : parse_inline_start() : error while flushing text buffer.\n");
           return err;
         }
 
-      append_child (*current_node, new_node);
+      node_t *new_node = tree_new_node (tree);
+      new_node->type = params.new_node_type;
+      append_child (tree, *current_node, new_node);
       *current_node = new_node;
     }
 
@@ -8,13 +8,20 @@
 #include "parse_inline_start.h"
 #include "parse_inline_end.h"
 #include "parser.h"
+#include "reader.h"
+#include "scan.h"
 #include "utils.h"
 
 /*
- * Add text to a text node.
+ * Add `len` bytes of text to a text node.
+ *
+ * With `zero_copy`, the node just references the input as long as
+ * its text is contiguous in it. Otherwise, text is copied in memory
+ * owned by the node, which capacity doubles when it's full, so
+ * appending is linear in the size of the text.
  */
 static int
-append_text (node_t *text_node, const char *text)
+append_text (arena_t *arena, node_t *text_node, char *text, size_t len, bool zero_copy)
 {
   if (text_node->type != NODE_TEXT)
     {
@@ -22,129 +29,355 @@ append_text (node_t *text_node, const char *text)
       return 1;
     }
 
-  size_t len = text_node->text_content ? strlen (text_node->text_content) : 0;
-  text_node->text_content = xrealloc (text_node->text_content, len + strlen (text) + 1);
-  snprintf (text_node->text_content + len, strlen (text) + 1, "%s", text);
+  if (zero_copy && text_node->text_capacity == 0)
+    {
+      if (text_node->text_len == 0)
+        {
+          text_node->text_content = text;
+          text_node->text_len = len;
+          return 0;
+        }
+
+      if (text_node->text_content + text_node->text_len == text)
+        {
+          text_node->text_len += len;
+          return 0;
+        }
+    }
+
+  size_t needed = text_node->text_len + len;
+  if (needed > text_node->text_capacity)
+    {
+      size_t capacity = (size_t) text_node->text_capacity * 2;
+      if (capacity < needed)
+        capacity = needed;
+
+      if (capacity > UINT32_MAX)
+        capacity = UINT32_MAX;
+
+      if (text_node->text_capacity)
+        text_node->text_content = arena_realloc (arena, text_node->text_content, text_node->text_capacity, capacity);
+      else
+        {
+          // materialize the slice of the input.
+          char *owned = arena_alloc (arena, capacity);
+          if (text_node->text_len)
+            memcpy (owned, text_node->text_content, text_node->text_len);
+
+          text_node->text_content = owned;
+        }
+
+      text_node->text_capacity = capacity;
+    }
+
+  if (len)
+    memcpy (text_node->text_content + text_node->text_len, text, len);
+
+  text_node->text_len += len;
 
   return 0;
 }
 
 /*
- * Add a child to a parent's memory.
+ * Start the nodes of a document, which are allocated in `arena`.
+ * Its root is created at TREE_ROOT.
  */
 void
-append_child (node_t *parent, node_t *child)
+tree_init (tree_t *tree, arena_t *arena)
 {
-  parent->children_len++;
-  parent->children = xrealloc (parent->children, parent->children_len * sizeof (*child));
-  parent->children[parent->children_len - 1] = child;
+  *tree = (tree_t) { .arena = arena };
 
-  child->parent = parent;
-  parent->last_child = child;
+  tree_new_node (tree); // NO_NODE, never used.
 
-  if (parent->children_len > 1)
-    parent->children[parent->children_len - 2]->next_sibling = child;
+  node_t *root = tree_new_node (tree);
+  root->type = NODE_ROOT;
+  root->flags = NODE_BLOCK_LEVEL | NODE_CAN_HAVE_BLOCK_CHILDREN;
 }
 
 /*
- * Write text buffer to text node.
+ * Create a zeroed node, stored after all nodes created before it.
+ */
+node_t *
+tree_new_node (tree_t *tree)
+{
+  if (tree->len == UINT32_MAX)
+    {
+      fprintf (stderr, "parser.c : tree_new_node() : too many nodes in document.\n");
+      exit (1);
+    }
+
+  if (tree->len % TREE_CHUNK_LEN == 0)
+    {
+      if (tree->chunks_len == tree->chunks_capacity)
+        {
+          size_t capacity = tree->chunks_capacity ? tree->chunks_capacity * 2 : 16;
+          tree->chunks = arena_realloc (tree->arena, tree->chunks, tree->chunks_capacity * sizeof (*tree->chunks), capacity * sizeof (*tree->chunks));
+          tree->chunks_capacity = capacity;
+        }
+
+      tree->chunks[tree->chunks_len++] = arena_alloc (tree->arena, TREE_CHUNK_LEN * sizeof (node_t));
+    }
+
+  node_t *node = &tree->chunks[tree->len / TREE_CHUNK_LEN][tree->len % TREE_CHUNK_LEN];
+  node->id = tree->len++;
+
+  return node;
+}
+
+/*
+ * Flags a node brings to the summary of its ancestors.
+ */
+static unsigned int
+subtree_flags (node_t *node)
+{
+  unsigned int flags = node->flags & (NODE_CONTAINS_LINK | NODE_CONTAINS_TEMPLATE);
+
+  if (node->flags & NODE_BLOCK_LEVEL)
+    return node->type == NODE_BLOCKLEVEL_TEMPLATE ? flags | NODE_CONTAINS_TEMPLATE : flags;
+
+  if (node->type == NODE_INTERNAL_LINK || node->type == NODE_EXTERNAL_LINK)
+    flags |= NODE_CONTAINS_LINK;
+  else if (node->type == NODE_INLINE_TEMPLATE)
+    flags |= NODE_CONTAINS_TEMPLATE;
+
+  return flags;
+}
+
+/*
+ * Add a child after the last one of a parent.
+ *
+ * The summary of the parent and its ancestors is updated. A flag set
+ * on a node is always set on all its ancestors, so it stops as soon as
+ * there is nothing new, which keeps it amortized constant time.
+ */
+void
+append_child (tree_t *tree, node_t *parent, node_t *child)
+{
+  if (parent->last_child)
+    tree_node (tree, parent->last_child)->next_sibling = child->id;
+  else
+    parent->first_child = child->id;
+
+  child->previous_sibling = parent->last_child;
+
+  child->parent = parent->id;
+  parent->last_child = child->id;
+
+  if (!is_empty_text_node (child))
+    parent->non_empty_children_len++;
+
+  if (!(child->flags & NODE_BLOCK_LEVEL) && child->type == NODE_TABLE_HEADER)
+    parent->flags |= NODE_CONTAINS_HEADER_CELL;
+
+  unsigned int flags = subtree_flags (child);
+  for (node_t *node = parent; node && (node->flags & flags) != flags; node = tree_node (tree, node->parent))
+    node->flags |= flags;
+}
+
+/*
+ * Write text buffer to text node, and empty it.
+ *
+ * A text node can't hold more than UINT32_MAX bytes, a new one is
+ * started past that.
  */
 int
-flush_text_buffer (node_t *current_node, char *buffer, char **buffer_ptr)
+flush_text_buffer (tree_t *tree, node_t *current_node, text_buffer_t *text)
 {
   int err = 0;
+  size_t len = text->end - text->start;
+  node_t *text_node = tree_node (tree, current_node->last_child);
 
-  if (!current_node->children || current_node->last_child->type != NODE_TEXT)
+  if (!text_node || text_node->type != NODE_TEXT || text_node->text_len + len > UINT32_MAX)
     {
-      node_t *text_node = xalloc (sizeof *text_node);
+      text_node = tree_new_node (tree);
       text_node->type = NODE_TEXT;
-      append_child (current_node, text_node);
+      append_child (tree, current_node, text_node);
     }
 
-  err = append_text (current_node->last_child, buffer);
+  bool was_empty = is_empty_text_node (text_node);
+  err = append_text (tree->arena, text_node, text->start, len, text->zero_copy);
   if (err)
     {
       fprintf (stderr, "parser.c : flush_text_buffer() : error while append text to text node.\n");
       return err;
     }
 
-  memset (buffer, 0, BUFSIZ);
-  if (buffer_ptr)
-    *buffer_ptr = buffer;
+  if (was_empty && !is_empty_text_node (text_node))
+    current_node->non_empty_children_len++;
+
+  text->start = text->end;
 
   return err;
 }
 
 /*
- * Cleanup memory for a node.
+ * Token at the reading position. It's only lexed again once
+ * reading moved.
  */
-void
-free_node (node_t *node)
+token_t *
+current_token (parser_state_t *state)
 {
-  if (node->text_content)
-    free (node->text_content);
-
-  if (node->children)
+  if (state->token_ptr != state->reading_ptr)
     {
-      for (size_t i = 0; i < node->children_len; i++)
-        free_node (node->children[i]);
+      state->token = lex (state->reading_ptr);
+      state->token_ptr = state->reading_ptr;
+    }
 
-      free (node->children);
+  return &state->token;
+}
+
+/*
+ * Record that `block`, a block level node, became the current node
+ * or one of its ancestors.
+ *
+ * Parsers call it when they enter a block level node, and `pop_block()`
+ * when they leave one, so the block the current node is in is always
+ * known, without walking up the tree.
+ */
+void
+push_block (parser_state_t *state, node_t *block)
+{
+  if (state->blocks_len == state->blocks_capacity)
+    {
+      size_t capacity = state->blocks_capacity ? state->blocks_capacity * 2 : 16;
+      state->blocks = arena_realloc (state->tree->arena, state->blocks, state->blocks_capacity * sizeof (*state->blocks), capacity * sizeof (*state->blocks));
+      state->blocks_capacity = capacity;
     }
 
-  free (node);
+  state->blocks[state->blocks_len++] = block->id;
+}
+
+/*
+ * Record that the last block given to `push_block()` isn't the current
+ * node or one of its ancestors anymore.
+ */
+void
+pop_block (parser_state_t *state)
+{
+  if (state->blocks_len)
+    state->blocks_len--;
+}
+
+/*
+ * Nearest block level node among the current node and its ancestors,
+ * or NULL if there is none.
+ */
+node_t *
+current_block (parser_state_t *state)
+{
+  return state->blocks_len ? tree_node (state->tree, state->blocks[state->blocks_len - 1]) : NULL;
+}
+
+/*
+ * Load input past `end`, for lookahead which needs to see further
+ * than what is loaded. Pending text is kept when it's still in the
+ * input, and lookahead positions are found again.
+ *
+ * Returns false when there is no more input, or on read error, which
+ * is then reported by the next refill.
+ */
+bool
+load_more_input (parser_state_t *state)
+{
+  size_t text_len = state->text.end - state->text.start;
+  bool in_input = text_len && state->text.start != state->scratch;
+
+  if (state->reader->eof)
+    return false;
+
+  int err = reader_extend (state->reader, &state->reading_ptr, in_input ? &state->text.start : NULL);
+  if (err)
+    return false;
+
+  if (in_input)
+    state->text.end = state->text.start + text_len;
+  else if (!text_len)
+    state->text.start = state->text.end = state->reading_ptr;
+
+  state->end = state->reader->end;
+  state->next_newline = NULL;
+  state->next_template_end = NULL;
+  state->next_nul = NULL;
+  state->token_ptr = NULL;
+
+  return true;
 }
 
 /*
  * Build a representation of the document, so that it's
  * then easier to serialize.
  *
- * The result is stored in `root`. You should provide
- * the memory for it, and clean its content with `free_node()`.
+ * Text nodes may reference the content of `reader`, so it must
+ * not be closed before the tree is released.
+ *
+ * The result is stored in `tree`, which must have been started with
+ * `tree_init()`, under its root. All nodes are allocated in its
+ * arena, so the whole tree is released with `arena_release()`.
  */
 int
-parse (const char *filename, node_t *root)
+parse (reader_t *reader, tree_t *tree)
 {
   int err = 0;
-  char content[MAX_FILE_SIZE] = {0};
-  FILE *file = NULL;
+  char scratch[BUFSIZ]; // pending text, once it's not contiguous in the input.
+  bool nowiki = false;
+  parser_state_t state = {
+    .reader = reader,
+    .tree = tree,
+    .current_node = tree_node (tree, TREE_ROOT),
+    .reading_ptr = reader->buffer,
+    .end = reader->end,
+    .text = { .start = reader->buffer, .end = reader->buffer },
+    .scratch = scratch,
+  };
+
+  push_block (&state, state.current_node);
 
-  file = fopen (filename, "r");
-  if (!file)
+  while (true)
     {
-      fprintf (stderr, "parser.c : parse() : can't read file %s\n", filename);
-      goto cleanup;
-    }
+      node_t *initial_node = state.current_node;
+      size_t text_len = state.text.end - state.text.start;
 
-  size_t content_len = fread (content, 1, MAX_FILE_SIZE - 1, file);
-  if (content_len == MAX_FILE_SIZE - 1)
-    fprintf (stderr, "parser.c : parse() : warning : input file has probably been truncated due to its size.\n");
+      bool copied = text_len && state.text.start == scratch;
 
-  node_t *current_node = root;
-  char *reading_ptr = content;
-  char buffer[BUFSIZ] = {0};
-  char *buffer_ptr = buffer;
-  bool nowiki = false;
+      char *previous_reading_ptr = state.reading_ptr;
+      err = reader_refill (reader, &state.reading_ptr, text_len && !copied ? &state.text.start : NULL);
+      if (err)
+        {
+          fprintf (stderr, "parser.c : parse() : error while reading input.\n");
+          return err;
+        }
 
-  while (true)
-    {
-      node_t *initial_node = current_node;
+      // content moved or grew, lookahead has to be done again.
+      if (state.reading_ptr != previous_reading_ptr || state.end != reader->end)
+        {
+          state.end = reader->end;
+          state.next_newline = NULL;
+          state.next_template_end = NULL;
+          state.next_nul = NULL;
+          state.token_ptr = NULL;
+        }
+
+      if (!text_len)
+        state.text.start = state.reading_ptr;
+
+      state.text.end = state.text.start + text_len;
+      state.text.zero_copy = reader->eof && !copied;
 
-      if (strncmp (reading_ptr, "<nowiki>", 8) == 0 && !nowiki)
+      if (current_token (&state)->kind == TOKEN_OPEN_NOWIKI && !nowiki)
         {
           nowiki = true;
-          reading_ptr += 8;
+          state.reading_ptr += 8;
         }
 
-      if (strncmp (reading_ptr, "</nowiki>", 9) == 0 && nowiki)
+      if (current_token (&state)->kind == TOKEN_CLOSE_NOWIKI && nowiki)
         {
           nowiki = false;
-          reading_ptr += 9;
+          state.reading_ptr += 9;
         }
 
       if (!nowiki)
         {
-          err = parse_block_end (&current_node, &reading_ptr, buffer, &buffer_ptr);
+          err = parse_block_end (&state);
           if (err)
             {
               fprintf (stderr, "parser.c : parse() : error while parsing block end.\n");
@@ -152,45 +385,64 @@ parse (const char *filename, node_t *root)
             }
 
 
-          err = parse_block_start (&current_node, &reading_ptr);
+          err = parse_block_start (&state);
           if (err)
             {
               fprintf (stderr, "parser.c : parse() : error while parsing block start.\n");
               return err;
             }
 
-          if (!current_node)
+          if (!state.current_node)
             break;
 
-          if (current_node != initial_node)
+          if (state.current_node != initial_node)
             continue;
 
 
-          err = parse_inline_start (&current_node, &reading_ptr, buffer, &buffer_ptr);
+          err = parse_inline_start (&state);
           if (err)
             {
               fprintf (stderr, "parser.c : parse() : error while parsing for inline tag start.\n");
               return err;
             }
 
-          if (current_node != initial_node)
+          if (state.current_node != initial_node)
             continue;
 
 
-          err = parse_inline_end (&current_node, &reading_ptr, buffer, &buffer_ptr);
+          err = parse_inline_end (&state);
           if (err)
             {
               fprintf (stderr, "parser.c : parse() : error while parsing for inline tag end.\n");
               return err;
             }
 
-          if (current_node != initial_node)
+          if (state.current_node != initial_node)
             continue;
         }
 
-      if (buffer_ptr - buffer == BUFSIZ - 1)
+      // a tag consumed everything that was loaded.
+      if (state.reading_ptr >= state.end)
         {
-          err = flush_text_buffer (current_node, buffer, &buffer_ptr);
+          if (!reader->eof)
+            continue;
+
+          return flush_text_buffer (tree, state.current_node, &state.text);
+        }
+
+      // markup has been skipped without flushing text, it's not contiguous anymore.
+      if (state.text.end != state.reading_ptr && state.text.end != state.text.start && state.text.start != scratch)
+        {
+          size_t len = state.text.end - state.text.start;
+          memmove (scratch, state.text.start, len);
+          state.text.start = scratch;
+          state.text.end = scratch + len;
+          state.text.zero_copy = false;
+        }
+
+      if (state.text.end - state.text.start >= BUFSIZ - 1)
+        {
+          err = flush_text_buffer (tree, state.current_node, &state.text);
           if (err)
             {
               fprintf (stderr, "parser.c : parse() : error while append flushing text buffer.\n");
@@ -198,21 +450,38 @@ parse (const char *filename, node_t *root)
             }
         }
 
-      buffer_ptr[0] = reading_ptr[0];
-      buffer_ptr[1] = 0;
+      if (state.text.end == state.text.start)
+        state.text.start = state.text.end = state.reading_ptr;
+
+      if (state.text.start == scratch)
+        state.text.end[0] = state.reading_ptr[0];
 
-      buffer_ptr++;
-      reading_ptr++;
+      state.text.end++;
+      state.reading_ptr++;
 
-      if ((size_t) (reading_ptr - content) >= content_len - 1)
+      /*
+       * Plain text can't change the current node, unless it's a node
+       * which starts a new block on any character, so the whole run
+       * can be added without going through the parsers.
+       */
+      if (nowiki || !(state.current_node->flags & NODE_CAN_HAVE_BLOCK_CHILDREN))
         {
-          flush_text_buffer (current_node, buffer, &buffer_ptr);
-          break;
+          char *limit = state.end;
+          if (limit > state.reading_ptr + (BUFSIZ - 1 - (state.text.end - state.text.start)))
+            limit = state.reading_ptr + (BUFSIZ - 1 - (state.text.end - state.text.start));
+
+          char *run = state.reading_ptr;
+          state.reading_ptr = scan_markup (state.reading_ptr, limit);
+
+          if (state.text.start == scratch)
+            memcpy (state.text.end, run, state.reading_ptr - run);
+
+          state.text.end += state.reading_ptr - run;
         }
+
+      if (reader->eof && state.reading_ptr >= state.end)
+        return flush_text_buffer (tree, state.current_node, &state.text);
     }
 
-  cleanup:
-  if (file) fclose (file);
   return err;
 }
-
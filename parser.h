@@ -1,64 +1,216 @@
 #ifndef _PARSER_H_
 #define _PARSER_H_
 
-#define MAX_FILE_SIZE 500000
+#include <stdint.h>
+
+#include "arena.h"
+#include "lex.h"
+#include "reader.h"
+
+/*
+ * Node types, with the name of their handlers. Tables indexed by node
+ * type are built from those lists, so a type without its handler, or
+ * with two of them, doesn't compile.
+ */
+#define BLOCK_LEVEL_NODE_TYPES(X)                                              \
+  X (NODE_BLOCKLEVEL_TEMPLATE, template)                            /* 0 */    \
+  X (NODE_BULLET_LIST, bullet_list)                                 /* 1 */    \
+  X (NODE_BULLET_LIST_ITEM, bullet_list_item)                       /* 2 */    \
+  X (NODE_DEFINITION_LIST, definition_list)                         /* 3 */    \
+  X (NODE_DEFINITION_LIST_DEFINITION, definition_list_definition)   /* 4 */    \
+  X (NODE_DEFINITION_LIST_TERM, definition_list_term)               /* 5 */    \
+  X (NODE_GALLERY, gallery)                                         /* 6 */    \
+  X (NODE_GALLERY_ITEM, gallery_item)                               /* 7 */    \
+  X (NODE_HEADING, heading)                                         /* 8 */    \
+  X (NODE_HORIZONTAL_RULE, horizontal_rule)                         /* 9 */    \
+  X (NODE_NUMBERED_LIST, numbered_list)                             /* 10 */   \
+  X (NODE_NUMBERED_LIST_ITEM, numbered_list_item)                   /* 11 */   \
+  X (NODE_PARAGRAPH, paragraph)                                     /* 12 */   \
+  X (NODE_PREFORMATTED_TEXT, preformatted_text)                     /* 13 */   \
+  X (NODE_TABLE, table)                                             /* 14 */   \
+  X (NODE_TABLE_CAPTION, table_caption)                             /* 15 */   \
+  X (NODE_TABLE_ROW, table_row)                                     /* 16 */
+
+#define INLINE_NODE_TYPES(X)                                                   \
+  X (NODE_TEXT, text)                                               /* 0 */    \
+  X (NODE_EMPHASIS, emphasis)                                       /* 1 */    \
+  X (NODE_EXTERNAL_LINK, external_link)                             /* 2 */    \
+  X (NODE_INLINE_TEMPLATE, template)                                /* 3 */    \
+  X (NODE_INTERNAL_LINK, internal_link)                             /* 4 */    \
+  X (NODE_MEDIA, media)                                             /* 5 */    \
+  X (NODE_STRONG, strong)                                           /* 6 */    \
+  X (NODE_STRONG_AND_EMPHASIS, strong_and_emphasis)                 /* 7 */    \
+  X (NODE_TABLE_HEADER, table_header)                               /* 8 */    \
+  X (NODE_TABLE_CELL, table_cell)                                   /* 9 */
+
+#define NODE_TYPE_ENUM(node_type, name) node_type,
 
 // block level nodes
 enum {
-  NODE_BLOCKLEVEL_TEMPLATE,               // 0
-  NODE_BULLET_LIST,                       // 1
-  NODE_BULLET_LIST_ITEM,                  // 2
-  NODE_DEFINITION_LIST,                   // 3
-  NODE_DEFINITION_LIST_DEFINITION,        // 4
-  NODE_DEFINITION_LIST_TERM,              // 5
-  NODE_GALLERY,                           // 6
-  NODE_GALLERY_ITEM,                      // 7
-  NODE_HEADING,                           // 8
-  NODE_HORIZONTAL_RULE,                   // 9
-  NODE_NUMBERED_LIST,                     // 10
-  NODE_NUMBERED_LIST_ITEM,                // 11
-  NODE_PARAGRAPH,                         // 12
-  NODE_PREFORMATTED_TEXT,                 // 13
-  NODE_TABLE,                             // 14
-  NODE_TABLE_CAPTION,                     // 15
-  NODE_TABLE_ROW,                         // 16
+  BLOCK_LEVEL_NODE_TYPES (NODE_TYPE_ENUM)
   BLOCK_LEVEL_NODES_COUNT,
   NODE_ROOT, // that one is special - 18
 };
 
 // inline nodes
 enum {
-  NODE_TEXT,                    // 0
-  NODE_EMPHASIS,                // 1
-  NODE_EXTERNAL_LINK,           // 2
-  NODE_INLINE_TEMPLATE,         // 3
-  NODE_INTERNAL_LINK,           // 4
-  NODE_MEDIA,                   // 5
-  NODE_STRONG,                  // 6
-  NODE_STRONG_AND_EMPHASIS,     // 7
-  NODE_TABLE_HEADER,            // 8
-  NODE_TABLE_CELL,              // 9
+  INLINE_NODE_TYPES (NODE_TYPE_ENUM)
   INLINE_NODES_COUNT,
   NODE_NOWIKI, // that one is a bit peculiar too - 11
 };
 
+/*
+ * Flags of a node, in `node_t.flags`.
+ *
+ * The `NODE_CONTAINS_*` ones are a summary of its subtree. They're
+ * maintained by `append_child()` as the tree is built, so dumpers
+ * don't have to walk subtrees to make decisions.
+ */
+enum {
+  NODE_CONTAINS_LINK = 1 << 0, // internal or external link anywhere below.
+  NODE_CONTAINS_TEMPLATE = 1 << 1, // inline or block level template anywhere below.
+  NODE_CONTAINS_HEADER_CELL = 1 << 2, // table header cell as a direct child.
+  NODE_BLOCK_LEVEL = 1 << 3, // `type` is one of the block level nodes.
+  NODE_CAN_HAVE_BLOCK_CHILDREN = 1 << 4,
+};
+
+/*
+ * Templates can't be longer than that. Lookahead for their end doesn't
+ * load input further, so an unclosed `{{` doesn't pull the rest of the
+ * input in memory.
+ */
+#define TEMPLATE_MAX_LEN 262144
+
+/*
+ * Index of a node in its `tree_t`. NO_NODE is never given to a node,
+ * so it's used for missing parent, children or sibling.
+ */
+typedef uint32_t node_id_t;
+#define NO_NODE 0
+
+/*
+ * `text_content` is not NUL terminated, use `text_len`. When
+ * `text_capacity` is 0, it's a slice of the input buffer rather
+ * than memory owned by the node.
+ *
+ * Nodes reference each other by index, see `tree_node()`. Children
+ * are a list going from `first_child` through `next_sibling`, and
+ * back from `last_child` through `previous_sibling`.
+ */
 typedef struct _node_t {
-  size_t type;
-  size_t subtype;
   char *text_content;
-  bool is_block_level;
-  bool can_have_block_children;
-  struct _node_t **children;
-  size_t children_len;
-  struct _node_t *parent;
-  struct _node_t *last_child;
-  struct _node_t *previous_sibling;
-  struct _node_t *next_sibling;
+  uint32_t text_len;
+  uint32_t text_capacity;
+  node_id_t id;
+  node_id_t parent;
+  node_id_t first_child;
+  node_id_t last_child;
+  node_id_t next_sibling;
+  node_id_t previous_sibling;
+  uint32_t non_empty_children_len; // children which are not empty text nodes.
+  uint8_t type;
+  uint8_t subtype;
+  uint8_t flags;
 } node_t;
 
-void append_child (node_t *parent, node_t *child);
-int flush_text_buffer (node_t *current_node, char *buffer, char **buffer_ptr);
-void free_node (node_t *node);
-int parse (const char *filename, node_t *root);
+/*
+ * Nodes are stored in chunks of that many.
+ */
+#define TREE_CHUNK_LEN 512
+
+/*
+ * Index of the root node, which is created with the tree.
+ */
+#define TREE_ROOT 1
+
+/*
+ * Nodes of a document, allocated in `arena`.
+ *
+ * Nodes are stored in creation order, which is the document order
+ * (parents before their children, children in order), so walking the
+ * tree goes through memory sequentially. They're in chunks rather than
+ * in a single array, so a node never moves once created and parsers
+ * can keep pointers to the nodes they are working on.
+ */
+typedef struct {
+  arena_t *arena;
+  node_t **chunks;
+  size_t chunks_len;
+  size_t chunks_capacity;
+  node_id_t len; // created nodes, including the unused NO_NODE one.
+} tree_t;
+
+/*
+ * Node at index `id` in `tree`, or NULL for NO_NODE.
+ */
+static inline node_t *
+tree_node (const tree_t *tree, node_id_t id)
+{
+  return id == NO_NODE ? NULL : &tree->chunks[id / TREE_CHUNK_LEN][id % TREE_CHUNK_LEN];
+}
+
+/*
+ * Range of the input read as text, but not added to a text node yet.
+ *
+ * When `zero_copy` is set, the input won't move anymore and will
+ * outlive the tree, so text nodes can point to it directly.
+ */
+typedef struct {
+  char *start;
+  char *end;
+  bool zero_copy;
+} text_buffer_t;
+
+/*
+ * State of the document being parsed, shared by `parse()` and
+ * the block and inline parsers.
+ *
+ * Loaded input goes up to `end`, where it's NUL terminated, so
+ * parsers can check how much is left without scanning for it.
+ */
+typedef struct {
+  reader_t *reader;
+  tree_t *tree;
+  node_t *current_node;
+  char *reading_ptr;
+  char *end;
+  text_buffer_t text;
+  char *scratch; // where `text` is copied once it's not contiguous in the input.
+
+  /*
+   * Next newline, `}}` and NUL byte in loaded input, found lazily
+   * so lookahead doesn't scan the same content over and over. They're
+   * `end` if there is none, and NULL when unknown. The cached values
+   * are reset when the loaded input changes.
+   */
+  char *next_newline;
+  char *next_template_end;
+  char *next_nul;
+
+  // token at `token_ptr`, see `current_token()`.
+  token_t token;
+  char *token_ptr;
+
+  /*
+   * Block level nodes from the root to `current_node`, the last one
+   * being the block `current_node` is in. See `push_block()`.
+   */
+  node_id_t *blocks;
+  size_t blocks_len;
+  size_t blocks_capacity;
+} parser_state_t;
+
+#define REMAINING_LEN(state) ((size_t) ((state)->end - (state)->reading_ptr))
+
+void tree_init (tree_t *tree, arena_t *arena);
+node_t *tree_new_node (tree_t *tree);
+void append_child (tree_t *tree, node_t *parent, node_t *child);
+int flush_text_buffer (tree_t *tree, node_t *current_node, text_buffer_t *text);
+token_t *current_token (parser_state_t *state);
+void push_block (parser_state_t *state, node_t *block);
+void pop_block (parser_state_t *state);
+node_t *current_block (parser_state_t *state);
+bool load_more_input (parser_state_t *state);
+int parse (reader_t *reader, tree_t *tree);
 
 #endif
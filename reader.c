@@ -0,0 +1,217 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "reader.h"
+#include "utils.h"
+
+/*
+ * Read from file until the buffer is full or the file is exhausted.
+ */
+static int
+fill (reader_t *reader)
+{
+  size_t available = reader->capacity - 1 - (reader->end - reader->buffer);
+
+  while (available > 0 && !reader->eof)
+    {
+      size_t read_len = fread (reader->end, 1, available, reader->file);
+      if (read_len < available)
+        {
+          if (ferror (reader->file))
+            {
+              fprintf (stderr, "reader.c : fill() : error while reading input.\n");
+              reader->failed = true;
+              return 1;
+            }
+
+          reader->eof = true;
+        }
+
+      reader->end += read_len;
+      available -= read_len;
+    }
+
+  reader->end[0] = 0;
+
+  return 0;
+}
+
+/*
+ * Try to map the whole file in memory, so it can be parsed in place.
+ *
+ * The kernel zero fills the end of the last page, which gives us the
+ * terminating NUL for free. When the file size is an exact multiple of
+ * the page size, there is no such sentinel, so we don't map it.
+ *
+ * Returns true if the file has been mapped.
+ */
+static bool
+map (reader_t *reader)
+{
+  struct stat info;
+  long page_size = sysconf (_SC_PAGESIZE);
+  int fd = fileno (reader->file);
+
+  if (fstat (fd, &info) != 0 || !S_ISREG (info.st_mode) || info.st_size == 0)
+    return false;
+
+  if (page_size <= 0 || info.st_size % page_size == 0)
+    return false;
+
+  void *mem = mmap (NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mem == MAP_FAILED)
+    return false;
+
+  reader->buffer = mem;
+  reader->end = reader->buffer + info.st_size;
+  reader->mapped_len = info.st_size;
+  reader->eof = true;
+
+  return true;
+}
+
+/*
+ * Open `filename` and load its content.
+ *
+ * Regular files are mapped in memory. Anything else (or any file
+ * that can't be mapped) is read by chunks of READER_BUFFER_SIZE.
+ *
+ * Content is always NUL terminated at `reader->end`.
+ */
+int
+reader_open (reader_t *reader, const char *filename)
+{
+  memset (reader, 0, sizeof *reader);
+
+  reader->file = fopen (filename, "r");
+  if (!reader->file)
+    {
+      fprintf (stderr, "reader.c : reader_open() : can't read file %s\n", filename);
+      return 1;
+    }
+
+  if (map (reader))
+    return 0;
+
+  reader->capacity = READER_BUFFER_SIZE;
+  reader->buffer = xalloc (reader->capacity);
+  reader->end = reader->buffer;
+
+  return fill (reader);
+}
+
+/*
+ * Read from `len` bytes of `content`, which are already in memory.
+ *
+ * `content[len]` must be a NUL byte. Content is not copied and is not
+ * freed by `reader_close()`.
+ */
+void
+reader_open_memory (reader_t *reader, char *content, size_t len)
+{
+  memset (reader, 0, sizeof *reader);
+  reader->buffer = content;
+  reader->end = content + len;
+  reader->eof = true;
+  reader->borrowed = true;
+}
+
+/*
+ * Move content to the start of the buffer, discarding what's before
+ * `reading_ptr`, or before `mark` if it's provided and comes first.
+ */
+static void
+compact (reader_t *reader, char **reading_ptr, char **mark)
+{
+  char *kept = mark && *mark < *reading_ptr ? *mark : *reading_ptr;
+  size_t shift = kept - reader->buffer;
+  size_t remaining = reader->end - kept;
+
+  memmove (reader->buffer, kept, remaining);
+  reader->end = reader->buffer + remaining;
+  *reading_ptr -= shift;
+  if (mark)
+    *mark -= shift;
+}
+
+/*
+ * Make sure at least READER_LOOKAHEAD bytes are available after
+ * `reading_ptr`, unless we're reaching the end of the file.
+ *
+ * Content before `reading_ptr` is discarded, unless `mark` is provided,
+ * in which case content is kept from the position it points to. Both
+ * pointers are moved accordingly when a refill happens.
+ *
+ * Once `reader->eof` is set, content never moves anymore.
+ */
+int
+reader_refill (reader_t *reader, char **reading_ptr, char **mark)
+{
+  if (reader->failed)
+    return 1;
+
+  if (reader->eof || reader->end - *reading_ptr >= READER_LOOKAHEAD)
+    return 0;
+
+  compact (reader, reading_ptr, mark);
+
+  return fill (reader);
+}
+
+/*
+ * Load more content than what is loaded, for lookahead which needs to
+ * see further than READER_LOOKAHEAD. The buffer doubles when it's
+ * full, so content from `reading_ptr` (or `mark`) is always kept.
+ *
+ * Pointers are moved like with `reader_refill()`.
+ */
+int
+reader_extend (reader_t *reader, char **reading_ptr, char **mark)
+{
+  if (reader->failed)
+    return 1;
+
+  if (reader->eof)
+    return 0;
+
+  compact (reader, reading_ptr, mark);
+
+  size_t len = reader->end - reader->buffer;
+  if (len + 1 == reader->capacity)
+    {
+      size_t reading_offset = *reading_ptr - reader->buffer;
+      size_t mark_offset = mark ? (size_t) (*mark - reader->buffer) : 0;
+
+      reader->capacity *= 2;
+      reader->buffer = xrealloc (reader->buffer, reader->capacity);
+      reader->end = reader->buffer + len;
+      *reading_ptr = reader->buffer + reading_offset;
+      if (mark)
+        *mark = reader->buffer + mark_offset;
+    }
+
+  return fill (reader);
+}
+
+/*
+ * Release memory and file descriptor.
+ */
+void
+reader_close (reader_t *reader)
+{
+  if (reader->file)
+    fclose (reader->file);
+
+  if (reader->mapped_len)
+    munmap (reader->buffer, reader->mapped_len);
+  else if (reader->buffer && !reader->borrowed)
+    free (reader->buffer);
+
+  memset (reader, 0, sizeof *reader);
+}
@@ -0,0 +1,37 @@
+#ifndef _READER_H_
+#define _READER_H_
+
+/*
+ * Initial size of the window the input is read into. It only grows
+ * when lookahead needs to see further, see `reader_extend()`.
+ */
+#define READER_BUFFER_SIZE 65536
+
+/*
+ * Minimum amount of content kept available after the reading
+ * position, so that markup probes never see a truncated tag.
+ */
+#define READER_LOOKAHEAD 16384
+
+/*
+ * Input content is read only: when the file is mapped, `buffer`
+ * points to read only memory.
+ */
+typedef struct {
+  FILE *file;
+  char *buffer;
+  char *end;
+  size_t capacity; // size of `buffer`, when the file is read by chunks.
+  bool eof;
+  bool failed; // a read error happened, every refill reports it from then.
+  size_t mapped_len; // non-zero when `buffer` is a memory mapping of the file.
+  bool borrowed; // `buffer` belongs to the caller, see `reader_open_memory()`.
+} reader_t;
+
+int reader_open (reader_t *reader, const char *filename);
+void reader_open_memory (reader_t *reader, char *content, size_t len);
+int reader_refill (reader_t *reader, char **reading_ptr, char **mark);
+int reader_extend (reader_t *reader, char **reading_ptr, char **mark);
+void reader_close (reader_t *reader);
+
+#endif
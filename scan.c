@@ -0,0 +1,165 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+#include "scan.h"
+
+/*
+ * Bytes markup can start with. Line level markup (lists, rules,
+ * preformatted text) only starts after a newline, so it's covered.
+ *
+ * Keep the vector kernels in sync when changing it.
+ */
+static const bool markup_chars[256] = {
+  [0] = true,
+  ['\n'] = true,
+  ['!'] = true,
+  ['\''] = true,
+  ['<'] = true,
+  ['='] = true,
+  ['['] = true,
+  [']'] = true,
+  ['{'] = true,
+  ['|'] = true,
+  ['}'] = true,
+};
+
+/*
+ * Portable kernel, one byte at a time.
+ */
+static char *
+scan_markup_scalar (char *ptr, const char *limit)
+{
+  while (ptr < limit && !markup_chars[(unsigned char) ptr[0]])
+    ptr++;
+
+  return ptr;
+}
+
+#ifdef SCAN_X86
+
+/*
+ * Check 16 bytes at a time, then finish with the scalar kernel.
+ */
+__attribute__ ((target ("sse2")))
+static char *
+scan_markup_sse2 (char *ptr, const char *limit)
+{
+  const __m128i nul = _mm_set1_epi8 (0);
+  const __m128i newline = _mm_set1_epi8 ('\n');
+  const __m128i bang = _mm_set1_epi8 ('!');
+  const __m128i quote = _mm_set1_epi8 ('\'');
+  const __m128i lower = _mm_set1_epi8 ('<');
+  const __m128i equal = _mm_set1_epi8 ('=');
+  const __m128i open_bracket = _mm_set1_epi8 ('[');
+  const __m128i close_bracket = _mm_set1_epi8 (']');
+  const __m128i open_brace = _mm_set1_epi8 ('{');
+  const __m128i pipe = _mm_set1_epi8 ('|');
+  const __m128i close_brace = _mm_set1_epi8 ('}');
+
+  while (limit - ptr >= 16)
+    {
+      __m128i chunk = _mm_loadu_si128 ((const __m128i *) ptr);
+      __m128i found = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, nul), _mm_cmpeq_epi8 (chunk, newline));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, bang));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, quote));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, lower));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, equal));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, open_bracket));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, close_bracket));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, open_brace));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, pipe));
+      found = _mm_or_si128 (found, _mm_cmpeq_epi8 (chunk, close_brace));
+
+      unsigned int mask = _mm_movemask_epi8 (found);
+      if (mask)
+        return ptr + __builtin_ctz (mask);
+
+      ptr += 16;
+    }
+
+  return scan_markup_scalar (ptr, limit);
+}
+
+/*
+ * Check 32 bytes at a time, then finish with the SSE2 kernel.
+ */
+__attribute__ ((target ("avx2")))
+static char *
+scan_markup_avx2 (char *ptr, const char *limit)
+{
+  const __m256i nul = _mm256_set1_epi8 (0);
+  const __m256i newline = _mm256_set1_epi8 ('\n');
+  const __m256i bang = _mm256_set1_epi8 ('!');
+  const __m256i quote = _mm256_set1_epi8 ('\'');
+  const __m256i lower = _mm256_set1_epi8 ('<');
+  const __m256i equal = _mm256_set1_epi8 ('=');
+  const __m256i open_bracket = _mm256_set1_epi8 ('[');
+  const __m256i close_bracket = _mm256_set1_epi8 (']');
+  const __m256i open_brace = _mm256_set1_epi8 ('{');
+  const __m256i pipe = _mm256_set1_epi8 ('|');
+  const __m256i close_brace = _mm256_set1_epi8 ('}');
+
+  while (limit - ptr >= 32)
+    {
+      __m256i chunk = _mm256_loadu_si256 ((const __m256i *) ptr);
+      __m256i found = _mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, nul), _mm256_cmpeq_epi8 (chunk, newline));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, bang));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, quote));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, lower));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, equal));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, open_bracket));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, close_bracket));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, open_brace));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, pipe));
+      found = _mm256_or_si256 (found, _mm256_cmpeq_epi8 (chunk, close_brace));
+
+      unsigned int mask = _mm256_movemask_epi8 (found);
+      if (mask)
+        return ptr + __builtin_ctz (mask);
+
+      ptr += 32;
+    }
+
+  return scan_markup_sse2 (ptr, limit);
+}
+
+#endif
+
+static char *(*markup_scanner) (char *ptr, const char *limit) = scan_markup_scalar;
+
+/*
+ * Pick the widest kernel the CPU supports. Runs before main(), so
+ * the choice is made once, before any thread may scan.
+ */
+__attribute__ ((constructor))
+static void
+select_scanner (void)
+{
+#ifdef SCAN_X86
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx2"))
+    markup_scanner = scan_markup_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    markup_scanner = scan_markup_sse2;
+#endif
+}
+
+/*
+ * Find the first byte that may be markup from `ptr`, up to `limit`
+ * (excluded). Return `limit` if there is none.
+ *
+ * Nothing is read at or after `limit`.
+ */
+char *
+scan_markup (char *ptr, const char *limit)
+{
+  return markup_scanner (ptr, limit);
+}
@@ -0,0 +1,6 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+char *scan_markup (char *ptr, const char *limit);
+
+#endif
@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "sink.h"
+#include "utils.h"
+
+/*
+ * Write buffer content to the file descriptor, except for
+ * the last `keep` bytes (or everything from `mark`, if it's more),
+ * which are moved to the start of the buffer.
+ */
+static int
+drain (sink_t *sink, size_t keep)
+{
+  size_t used = sink->writing_ptr - sink->buffer;
+  if (sink->mark && (size_t) (sink->writing_ptr - sink->mark) > keep)
+    keep = sink->writing_ptr - sink->mark;
+
+  if (keep > used)
+    keep = used;
+
+  char *reading_ptr = sink->buffer;
+  size_t len = used - keep;
+
+  while (len > 0)
+    {
+      ssize_t written = write (sink->fd, reading_ptr, len);
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          fprintf (stderr, "sink.c : drain() : can't write output : %s\n", strerror (errno));
+          return 1;
+        }
+
+      reading_ptr += written;
+      len -= written;
+    }
+
+  if (sink->mark)
+    sink->mark = sink->buffer + (sink->mark - reading_ptr);
+
+  memmove (sink->buffer, reading_ptr, keep);
+  sink->writing_ptr = sink->buffer + keep;
+  sink->writing_ptr[0] = 0;
+  sink->max_len = sink->capacity - keep;
+
+  return 0;
+}
+
+/*
+ * Prepare `sink` to write in `fd`, or in memory if `fd` is -1.
+ */
+void
+sink_init (sink_t *sink, int fd, size_t capacity)
+{
+  sink->fd = fd;
+  sink->buffer = xalloc (capacity);
+  sink->capacity = capacity;
+  sink->writing_ptr = sink->buffer;
+  sink->max_len = capacity;
+  sink->mark = NULL;
+}
+
+/*
+ * Write to `fd` from now on (or in memory if it's -1), keeping the
+ * buffer. Pending content is discarded.
+ */
+void
+sink_attach (sink_t *sink, int fd)
+{
+  sink->fd = fd;
+  sink->writing_ptr = sink->buffer;
+  sink->writing_ptr[0] = 0;
+  sink->max_len = sink->capacity;
+  sink->mark = NULL;
+}
+
+/*
+ * Make sure `len` bytes (plus the terminating NUL) can be written
+ * at `writing_ptr`, draining or growing the buffer as needed.
+ *
+ * Content from `mark` is kept in the buffer, so it can still be
+ * reworked, but it may move: `mark` is updated accordingly.
+ */
+int
+sink_reserve (sink_t *sink, size_t len)
+{
+  if (sink->max_len > len)
+    return 0;
+
+  if (sink->fd >= 0)
+    {
+      int err = drain (sink, SINK_KEPT_TAIL);
+      if (err)
+        {
+          fprintf (stderr, "sink.c : sink_reserve() : can't drain buffer.\n");
+          return err;
+        }
+
+      if (sink->max_len > len)
+        return 0;
+    }
+
+  size_t used = sink->writing_ptr - sink->buffer;
+  size_t capacity = sink->capacity;
+  while (capacity - used <= len)
+    capacity *= 2;
+
+  size_t mark_offset = sink->mark ? (size_t) (sink->mark - sink->buffer) : 0;
+  sink->buffer = xrealloc (sink->buffer, capacity);
+  sink->capacity = capacity;
+  if (sink->mark)
+    sink->mark = sink->buffer + mark_offset;
+
+  sink->writing_ptr = sink->buffer + used;
+  sink->max_len = capacity - used;
+
+  return 0;
+}
+
+/*
+ * Add `len` bytes from `src`, reserving space for them.
+ */
+int
+sink_write (sink_t *sink, const char *src, size_t len)
+{
+  int err = sink_reserve (sink, len);
+  if (err)
+    {
+      fprintf (stderr, "sink.c : sink_write() : can't reserve output space.\n");
+      return err;
+    }
+
+  sink_append (sink, src, len);
+
+  return 0;
+}
+
+/*
+ * Write all pending content to the file descriptor.
+ */
+int
+sink_flush (sink_t *sink)
+{
+  if (sink->fd < 0)
+    return 0;
+
+  return drain (sink, 0);
+}
+
+/*
+ * Write all content of a memory sink to `fd`, emptying it.
+ */
+int
+sink_write_to (sink_t *sink, int fd)
+{
+  int own_fd = sink->fd;
+  sink->fd = fd;
+  int err = drain (sink, 0);
+  sink->fd = own_fd;
+
+  return err;
+}
+
+/*
+ * Release sink memory. Pending content is not flushed.
+ */
+void
+sink_release (sink_t *sink)
+{
+  if (sink->buffer)
+    free (sink->buffer);
+
+  memset (sink, 0, sizeof *sink);
+}
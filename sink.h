@@ -0,0 +1,94 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+// part of the library interface, so it has to stand on its own.
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Functions of the library interface. The shared library is built
+ * with hidden visibility, so they're the only symbols it exports.
+ */
+#define W2M_EXPORT __attribute__ ((visibility ("default")))
+
+#define SINK_BUFFER_SIZE 65536
+
+/*
+ * Space guaranteed to be available when a dumper starts, and when
+ * it returns. Anything bigger must be reserved explicitly.
+ */
+#define SINK_MARGIN 4096
+
+/*
+ * Bytes kept in buffer when draining it, so dumpers can always
+ * look at what they just wrote.
+ */
+#define SINK_KEPT_TAIL 2
+
+/*
+ * Output buffer for dumpers.
+ *
+ * When `fd` is a file descriptor, content is written to it by large
+ * blocks when the buffer is full. When `fd` is -1, the buffer just
+ * grows as needed, and its content can be read from `buffer`, which
+ * is always NUL terminated.
+ */
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t capacity;
+  char *writing_ptr;
+  size_t max_len;
+  char *mark; // when set, content from there is never drained, see `sink_reserve()`.
+} sink_t;
+
+/*
+ * Output builder.
+ *
+ * Content is added at `writing_ptr`, keeping the buffer NUL terminated.
+ * `SINK_APPEND_LITERAL()` and `sink_append()` don't reserve space, they're
+ * for content fitting in what has been reserved already (or in the
+ * SINK_MARGIN guaranteed to dumpers). `sink_write()` reserves space
+ * for content of arbitrary length. To write content directly in the
+ * buffer, use `sink_reserve()`, then `sink_commit()` what was written.
+ */
+
+/*
+ * Add string literal `literal` to `sink`, its length being known
+ * at compile time.
+ */
+#define SINK_APPEND_LITERAL(sink, literal) sink_append ((sink), "" literal, sizeof (literal) - 1)
+
+/*
+ * Mark `len` bytes written at `writing_ptr` as part of the content.
+ */
+static inline void
+sink_commit (sink_t *sink, size_t len)
+{
+  sink->writing_ptr += len;
+  sink->max_len -= len;
+  sink->writing_ptr[0] = 0;
+}
+
+/*
+ * Add `len` bytes from `src`, in space already reserved. `src` may
+ * be NULL when `len` is 0, like the content of an empty text node.
+ */
+static inline void
+sink_append (sink_t *sink, const char *src, size_t len)
+{
+  if (len)
+    memcpy (sink->writing_ptr, src, len);
+
+  sink_commit (sink, len);
+}
+
+W2M_EXPORT void sink_init (sink_t *sink, int fd, size_t capacity);
+W2M_EXPORT void sink_attach (sink_t *sink, int fd);
+W2M_EXPORT int sink_reserve (sink_t *sink, size_t len);
+W2M_EXPORT int sink_write (sink_t *sink, const char *src, size_t len);
+W2M_EXPORT int sink_flush (sink_t *sink);
+W2M_EXPORT int sink_write_to (sink_t *sink, int fd);
+W2M_EXPORT void sink_release (sink_t *sink);
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Checks of the library API.
+ *
+ * usage: test/api
+ *
+ * All int returning functions returns non-zero in case of error, unless
+ * explicitly mentioned.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "wiki2md.h"
+
+/*
+ * Convert `len` bytes of `in` with `ctx`, and compare the result with
+ * `expected`, named `name` in the report.
+ */
+static int
+check (w2m_ctx_t *ctx, const char *name, const char *in, size_t len, const char *expected)
+{
+  sink_t sink;
+  sink_init (&sink, -1, SINK_BUFFER_SIZE);
+
+  int err = w2m_convert (ctx, in, len, &sink);
+  if (err)
+    fprintf (stderr, "FAIL : %s : conversion failed.\n", name);
+  else if (strcmp (sink.buffer, expected) != 0)
+    {
+      fprintf (stderr, "FAIL : %s : expected \"%s\", got \"%s\".\n", name, expected, sink.buffer);
+      err = 1;
+    }
+  else
+    printf ("ok : %s\n", name);
+
+  sink_release (&sink);
+
+  return err;
+}
+
+int
+main (void)
+{
+  int failures = 0;
+  w2m_ctx_t *ctx = w2m_ctx_new ();
+
+  failures += check (ctx, "buffer ending without a newline", "abc", 3, "abc\n\n\n");
+  failures += check (ctx, "buffer ending with a newline", "abc\n", 4, "abc\n\n\n\n");
+  failures += check (ctx, "length shorter than the buffer", "abcdef", 3, "abc\n\n\n");
+  failures += check (ctx, "link closed on the last byte", "[http://example.com x]", 22, "[x](http://example.com)\n\n\n");
+
+  w2m_ctx_free (ctx);
+
+  if (failures)
+    {
+      fprintf (stderr, "FAIL : %d failed.\n", failures);
+      return 1;
+    }
+
+  printf ("OK : all passed.\n");
+
+  return 0;
+}
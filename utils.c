@@ -12,7 +12,7 @@
 bool
 is_empty_text_node (node_t *node)
 {
-  return !node->is_block_level && node->type == NODE_TEXT && strnlen (node->text_content, 1) == 0;
+  return !(node->flags & NODE_BLOCK_LEVEL) && node->type == NODE_TEXT && node->text_len == 0;
 }
 
 /*
@@ -47,20 +47,67 @@ xrealloc (void *mem, size_t msize)
   return mem;
 }
 
+/*
+ * Position of the first `c` at or after `from`, or `end` if there
+ * is none. `*cursor` is reused as long as it's still ahead.
+ */
+static char *
+find_ahead (char **cursor, char *from, char *end, char c)
+{
+  if (!*cursor || *cursor < from)
+    {
+      char *found = memchr (from, c, end - from);
+      *cursor = found ? found : end;
+    }
+
+  return *cursor;
+}
+
+/*
+ * Same as `find_ahead()`, for the end of a template.
+ */
+static char *
+find_template_end_ahead (char **cursor, char *from, char *end)
+{
+  if (!*cursor || *cursor < from)
+    {
+      char *found = from;
+      while ((found = memchr (found, '}', end - found)) && found[1] != '}')
+        found++;
+
+      *cursor = found ? found : end;
+    }
+
+  return *cursor;
+}
+
 /*
  * Tell if we're in the edge case where a block level template has been started
  * inside a paragraph (mediawiki syntax allows that).
+ *
+ * Content is looked at up to the next NUL byte, like strstr() would. More
+ * input is loaded until the end of the template is found, so the result
+ * doesn't depend on how much of the input is loaded. A template not
+ * ending within TEMPLATE_MAX_LEN bytes is considered unterminated.
  */
 bool
-is_inline_block_template (char *reading_ptr)
+is_inline_block_template (parser_state_t *state)
 {
-  if (strncmp (reading_ptr, "{{", 2) != 0)
+  if (current_token (state)->kind != TOKEN_OPEN_TEMPLATE)
     return false;
 
-  char *end_of_template = strstr (reading_ptr, "}}");
-  char *end_of_line = strstr (reading_ptr, "\n");
+  char *nul = NULL;
+  char *end_of_template = NULL;
+  do
+    {
+      nul = find_ahead (&state->next_nul, state->reading_ptr, state->end, 0);
+      end_of_template = find_template_end_ahead (&state->next_template_end, state->reading_ptr, state->end);
+    }
+  while (end_of_template == state->end && nul == state->end && REMAINING_LEN (state) <= TEMPLATE_MAX_LEN && load_more_input (state));
+
+  char *end_of_line = find_ahead (&state->next_newline, state->reading_ptr, state->end, '\n');
 
-  if (!end_of_template || !end_of_line)
+  if (end_of_template >= nul || end_of_line >= nul || end_of_template - state->reading_ptr >= TEMPLATE_MAX_LEN)
     return false;
 
   return end_of_line < end_of_template;
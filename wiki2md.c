@@ -0,0 +1,152 @@
+/*
+ * Library entry points.
+ *
+ * All int returning functions returns non-zero in case of error, unless
+ * explicitly mentioned.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumper.h"
+#include "parser.h"
+#include "sink.h"
+#include "utils.h"
+#include "wiki2md.h"
+
+struct _w2m_ctx_t {
+  arena_t arena;
+  char *input; // NUL terminated copy of the input given to `w2m_convert()`.
+  size_t input_capacity;
+};
+
+/*
+ * Parse content from `reader` and write its markdown to `sink`.
+ */
+static int
+convert (w2m_ctx_t *ctx, reader_t *reader, sink_t *sink)
+{
+  w2m_ctx_reset (ctx);
+
+  tree_t tree;
+  tree_init (&tree, &ctx->arena);
+  int err = parse (reader, &tree);
+  if (err)
+    {
+      fprintf (stderr, "wiki2md.c : convert() : error while building representation of document.\n");
+      return err;
+    }
+
+  dumping_params_t params = {
+    .tree = &tree,
+    .node = tree_node (&tree, TREE_ROOT),
+    .sink = sink,
+  };
+
+  err = dump (&params);
+  if (err)
+    {
+      fprintf (stderr, "wiki2md.c : convert() : error while dumping markdown.\n");
+      return err;
+    }
+
+  SINK_APPEND_LITERAL (sink, "\n");
+
+  err = sink_flush (sink);
+  if (err)
+    {
+      fprintf (stderr, "wiki2md.c : convert() : error while writing markdown.\n");
+      return err;
+    }
+
+  return 0;
+}
+
+/*
+ * Create a conversion context, to be freed with `w2m_ctx_free()`.
+ */
+w2m_ctx_t *
+w2m_ctx_new (void)
+{
+  return xalloc (sizeof (w2m_ctx_t));
+}
+
+/*
+ * Convert `len` bytes of mediawiki markup from `in` to markdown,
+ * written to `sink`.
+ *
+ * Content is copied in a buffer owned by the context, since the parser
+ * needs it to be NUL terminated.
+ */
+int
+w2m_convert (w2m_ctx_t *ctx, const char *in, size_t len, sink_t *sink)
+{
+  if (len + 1 > ctx->input_capacity)
+    {
+      free (ctx->input);
+      ctx->input = xalloc (len + 1);
+      ctx->input_capacity = len + 1;
+    }
+
+  memcpy (ctx->input, in, len);
+  ctx->input[len] = 0;
+
+  reader_t reader;
+  reader_open_memory (&reader, ctx->input, len);
+  int err = convert (ctx, &reader, sink);
+  reader_close (&reader);
+
+  return err;
+}
+
+/*
+ * Convert the mediawiki markup file `filename` to markdown, written
+ * to `sink`.
+ *
+ * The file is read directly (mapped in memory when possible), without
+ * going through the context input buffer.
+ */
+int
+w2m_convert_file (w2m_ctx_t *ctx, const char *filename, sink_t *sink)
+{
+  reader_t reader;
+  int err = reader_open (&reader, filename);
+  if (err)
+    {
+      fprintf (stderr, "wiki2md.c : w2m_convert_file() : can't open file %s\n", filename);
+      reader_close (&reader);
+      return err;
+    }
+
+  err = convert (ctx, &reader, sink);
+  reader_close (&reader);
+
+  return err;
+}
+
+/*
+ * Forget the last converted document, keeping memory around for the
+ * next one. Conversions do it by themselves, this is only useful to
+ * discard the parse tree early.
+ */
+void
+w2m_ctx_reset (w2m_ctx_t *ctx)
+{
+  arena_reset (&ctx->arena);
+}
+
+/*
+ * Release all memory owned by the context.
+ */
+void
+w2m_ctx_free (w2m_ctx_t *ctx)
+{
+  if (!ctx)
+    return;
+
+  arena_release (&ctx->arena);
+  free (ctx->input);
+  free (ctx);
+}
@@ -0,0 +1,23 @@
+#ifndef _WIKI2MD_H_
+#define _WIKI2MD_H_
+
+#include "sink.h"
+
+/*
+ * Conversion context.
+ *
+ * It owns the memory used while converting a document (parse tree
+ * arena, input copy), which is kept between conversions so converting
+ * many documents doesn't go through the allocator again for each one.
+ *
+ * A context must not be used by several threads at once.
+ */
+typedef struct _w2m_ctx_t w2m_ctx_t;
+
+W2M_EXPORT w2m_ctx_t *w2m_ctx_new (void);
+W2M_EXPORT int w2m_convert (w2m_ctx_t *ctx, const char *in, size_t len, sink_t *sink);
+W2M_EXPORT int w2m_convert_file (w2m_ctx_t *ctx, const char *filename, sink_t *sink);
+W2M_EXPORT void w2m_ctx_reset (w2m_ctx_t *ctx);
+W2M_EXPORT void w2m_ctx_free (w2m_ctx_t *ctx);
+
+#endif
@@ -0,0 +1,491 @@
+/*
+ * All int returning functions returns non-zero in case of error, unless
+ * explicitly mentioned.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "utils.h"
+#include "xml_reader.h"
+
+/*
+ * Bytes needed to recognize any tag we look for, including the byte
+ * following its name.
+ */
+#define XML_TAG_MAX_LEN 16
+
+typedef struct {
+  const char *name;
+  size_t len;
+  char value;
+} entity_t;
+
+static const entity_t entities[] = {
+  { "&lt;", 4, '<' },
+  { "&gt;", 4, '>' },
+  { "&amp;", 5, '&' },
+  { "&quot;", 6, '"' },
+  { "&apos;", 6, '\'' },
+};
+
+/*
+ * Discard content before `pos` and read more from the file.
+ */
+static int
+fill (xml_reader_t *reader)
+{
+  if (reader->eof)
+    return 0;
+
+  memmove (reader->buffer, reader->buffer + reader->pos, reader->len - reader->pos);
+  reader->len -= reader->pos;
+  reader->pos = 0;
+
+  size_t available = XML_BUFFER_SIZE - reader->len;
+  size_t read_len = fread (reader->buffer + reader->len, 1, available, reader->file);
+  if (read_len < available)
+    {
+      if (ferror (reader->file))
+        {
+          fprintf (stderr, "xml_reader.c : fill() : error while reading input.\n");
+          return 1;
+        }
+
+      reader->eof = true;
+    }
+
+  reader->len += read_len;
+
+  return 0;
+}
+
+/*
+ * Make sure `len` bytes are available at `pos`, unless the file
+ * is exhausted.
+ */
+static int
+ensure (xml_reader_t *reader, size_t len)
+{
+  while (reader->len - reader->pos < len && !reader->eof)
+    {
+      int err = fill (reader);
+      if (err)
+        return err;
+    }
+
+  return 0;
+}
+
+/*
+ * Check if the tag at `pos` is named `tag` (including its opening
+ * `<`, or `</`).
+ */
+static bool
+matches_tag (xml_reader_t *reader, const char *tag)
+{
+  size_t tag_len = strlen (tag);
+  const char *ptr = reader->buffer + reader->pos;
+
+  if (reader->len - reader->pos <= tag_len || memcmp (ptr, tag, tag_len) != 0)
+    return false;
+
+  char next = ptr[tag_len];
+  return next == '>' || next == '/' || next == ' ' || next == '\t' || next == '\n' || next == '\r';
+}
+
+/*
+ * Move after the name of the first tag of `tags` found, `which` being
+ * set to its index. It's set to -1 if none is found before the end of
+ * the file.
+ */
+static int
+skip_to (xml_reader_t *reader, const char *const *tags, size_t count, int *which)
+{
+  *which = -1;
+
+  while (true)
+    {
+      char *start = reader->buffer + reader->pos;
+      char *found = memchr (start, '<', reader->len - reader->pos);
+      if (!found)
+        {
+          reader->pos = reader->len;
+          if (reader->eof)
+            return 0;
+
+          int err = fill (reader);
+          if (err)
+            return err;
+
+          continue;
+        }
+
+      reader->pos = found - reader->buffer;
+      int err = ensure (reader, XML_TAG_MAX_LEN);
+      if (err)
+        return err;
+
+      for (size_t i = 0; i < count; i++)
+        {
+          if (matches_tag (reader, tags[i]))
+            {
+              *which = i;
+              reader->pos += strlen (tags[i]);
+              return 0;
+            }
+        }
+
+      reader->pos++;
+    }
+}
+
+/*
+ * Move after the end of the current tag, telling if it was
+ * a self closing one.
+ */
+static int
+skip_tag_end (xml_reader_t *reader, bool *self_closing)
+{
+  while (true)
+    {
+      char *start = reader->buffer + reader->pos;
+      char *found = memchr (start, '>', reader->len - reader->pos);
+      if (found)
+        {
+          *self_closing = found > reader->buffer && found[-1] == '/';
+          reader->pos = found + 1 - reader->buffer;
+          return 0;
+        }
+
+      if (reader->eof)
+        {
+          fprintf (stderr, "xml_reader.c : skip_tag_end() : unterminated tag.\n");
+          return 1;
+        }
+
+      // keep the last byte, to know if the tag is self closing.
+      reader->pos = reader->len > reader->pos ? reader->len - 1 : reader->pos;
+      int err = fill (reader);
+      if (err)
+        return err;
+    }
+}
+
+/*
+ * Add `len` bytes from `src` to `*buffer`, keeping room for
+ * a terminating NUL.
+ */
+static void
+append (char **buffer, size_t *buffer_len, size_t *capacity, const char *src, size_t len)
+{
+  if (*buffer_len + len + 1 > *capacity)
+    {
+      size_t new_capacity = *capacity ? *capacity : BUFSIZ;
+      while (*buffer_len + len + 1 > new_capacity)
+        new_capacity *= 2;
+
+      *buffer = xrealloc (*buffer, new_capacity);
+      *capacity = new_capacity;
+    }
+
+  memcpy (*buffer + *buffer_len, src, len);
+  *buffer_len += len;
+  (*buffer)[*buffer_len] = 0;
+}
+
+/*
+ * Copy content until the `end_tag` closing tag into `*buffer`, and
+ * move after that tag.
+ *
+ * Markup is escaped in element content, so the first `<` is expected
+ * to start the closing tag.
+ */
+static int
+collect (xml_reader_t *reader, const char *end_tag, char **buffer, size_t *buffer_len, size_t *capacity)
+{
+  *buffer_len = 0;
+  append (buffer, buffer_len, capacity, "", 0);
+
+  while (true)
+    {
+      char *start = reader->buffer + reader->pos;
+      char *found = memchr (start, '<', reader->len - reader->pos);
+      size_t len = (found ? found : reader->buffer + reader->len) - start;
+      append (buffer, buffer_len, capacity, start, len);
+      reader->pos += len;
+
+      if (!found)
+        {
+          if (reader->eof)
+            {
+              fprintf (stderr, "xml_reader.c : collect() : missing %s> tag.\n", end_tag);
+              return 1;
+            }
+
+          int err = fill (reader);
+          if (err)
+            return err;
+
+          continue;
+        }
+
+      int err = ensure (reader, XML_TAG_MAX_LEN);
+      if (err)
+        return err;
+
+      if (matches_tag (reader, end_tag))
+        {
+          bool self_closing = false;
+          reader->pos += strlen (end_tag);
+          return skip_tag_end (reader, &self_closing);
+        }
+
+      append (buffer, buffer_len, capacity, "<", 1);
+      reader->pos++;
+    }
+}
+
+/*
+ * Write `code_point` in UTF-8 at `*writing_ptr`.
+ */
+static void
+write_utf8 (char **writing_ptr, uint32_t code_point)
+{
+  unsigned char *ptr = (unsigned char *) *writing_ptr;
+
+  if (code_point < 0x80)
+    *ptr++ = code_point;
+  else if (code_point < 0x800)
+    {
+      *ptr++ = 0xc0 | (code_point >> 6);
+      *ptr++ = 0x80 | (code_point & 0x3f);
+    }
+  else if (code_point < 0x10000)
+    {
+      *ptr++ = 0xe0 | (code_point >> 12);
+      *ptr++ = 0x80 | ((code_point >> 6) & 0x3f);
+      *ptr++ = 0x80 | (code_point & 0x3f);
+    }
+  else
+    {
+      *ptr++ = 0xf0 | (code_point >> 18);
+      *ptr++ = 0x80 | ((code_point >> 12) & 0x3f);
+      *ptr++ = 0x80 | ((code_point >> 6) & 0x3f);
+      *ptr++ = 0x80 | (code_point & 0x3f);
+    }
+
+  *writing_ptr = (char *) ptr;
+}
+
+/*
+ * Decode the entity at `reading_ptr`, writing its value at `*writing_ptr`.
+ *
+ * Returns the length of the entity, or 0 if it's not one we know.
+ * A decoded entity is never longer than its encoded form.
+ */
+static size_t
+decode_entity (const char *reading_ptr, const char *end, char **writing_ptr)
+{
+  size_t available = end - reading_ptr;
+
+  for (size_t i = 0; i < sizeof entities / sizeof entities[0]; i++)
+    {
+      if (available >= entities[i].len && memcmp (reading_ptr, entities[i].name, entities[i].len) == 0)
+        {
+          *(*writing_ptr)++ = entities[i].value;
+          return entities[i].len;
+        }
+    }
+
+  if (available < 4 || reading_ptr[1] != '#')
+    return 0;
+
+  bool hexadecimal = reading_ptr[2] == 'x' || reading_ptr[2] == 'X';
+  const char *ptr = reading_ptr + (hexadecimal ? 3 : 2);
+  const char *digits = ptr;
+  uint32_t code_point = 0;
+
+  while (ptr < end && ptr - digits < 8)
+    {
+      char c = *ptr;
+      uint32_t digit = 0;
+
+      if (c >= '0' && c <= '9')
+        digit = c - '0';
+      else if (hexadecimal && c >= 'a' && c <= 'f')
+        digit = c - 'a' + 10;
+      else if (hexadecimal && c >= 'A' && c <= 'F')
+        digit = c - 'A' + 10;
+      else
+        break;
+
+      code_point = code_point * (hexadecimal ? 16 : 10) + digit;
+      ptr++;
+    }
+
+  if (ptr == digits || ptr >= end || *ptr != ';')
+    return 0;
+
+  if (code_point == 0 || code_point > 0x10ffff || (code_point >= 0xd800 && code_point <= 0xdfff))
+    return 0;
+
+  write_utf8 (writing_ptr, code_point);
+
+  return ptr + 1 - reading_ptr;
+}
+
+/*
+ * Decode entities of `text` in place, returning its new length.
+ */
+static size_t
+decode_entities (char *text, size_t len)
+{
+  char *end = text + len;
+  char *reading_ptr = memchr (text, '&', len);
+  if (!reading_ptr)
+    return len;
+
+  char *writing_ptr = reading_ptr;
+  while (reading_ptr < end)
+    {
+      if (reading_ptr[0] == '&')
+        {
+          size_t consumed = decode_entity (reading_ptr, end, &writing_ptr);
+          if (consumed)
+            {
+              reading_ptr += consumed;
+              continue;
+            }
+        }
+
+      *writing_ptr++ = *reading_ptr++;
+    }
+
+  writing_ptr[0] = 0;
+
+  return writing_ptr - text;
+}
+
+/*
+ * Open the dump `filename`.
+ */
+int
+xml_reader_open (xml_reader_t *reader, const char *filename)
+{
+  memset (reader, 0, sizeof *reader);
+
+  reader->file = fopen (filename, "r");
+  if (!reader->file)
+    {
+      fprintf (stderr, "xml_reader.c : xml_reader_open() : can't read file %s\n", filename);
+      return 1;
+    }
+
+  reader->buffer = xalloc (XML_BUFFER_SIZE);
+
+  return 0;
+}
+
+/*
+ * Read the next page of the dump into `page`.
+ *
+ * Only the first revision of the page is considered. `found` is set
+ * to false when there is no page left.
+ */
+int
+xml_reader_next (xml_reader_t *reader, xml_page_t *page, bool *found)
+{
+  static const char *const page_tags[] = { "<page" };
+  static const char *const content_tags[] = { "<title", "<text", "</page" };
+
+  *found = false;
+  page->title_len = 0;
+  page->text_len = 0;
+  append (&page->title, &page->title_len, &page->title_capacity, "", 0);
+  append (&page->text, &page->text_len, &page->text_capacity, "", 0);
+
+  int which = -1;
+  bool self_closing = false;
+  int err = skip_to (reader, page_tags, 1, &which);
+  if (err || which < 0)
+    return err;
+
+  err = skip_tag_end (reader, &self_closing);
+  if (err)
+    return err;
+
+  bool has_text = false;
+  while (true)
+    {
+      err = skip_to (reader, content_tags, 3, &which);
+      if (err)
+        return err;
+
+      if (which < 0)
+        {
+          fprintf (stderr, "xml_reader.c : xml_reader_next() : unterminated page.\n");
+          return 1;
+        }
+
+      if (which == 2)
+        break;
+
+      err = skip_tag_end (reader, &self_closing);
+      if (err)
+        return err;
+
+      if (self_closing)
+        continue;
+
+      if (which == 0)
+        {
+          err = collect (reader, "</title", &page->title, &page->title_len, &page->title_capacity);
+          if (err)
+            return err;
+
+          page->title_len = decode_entities (page->title, page->title_len);
+        }
+      else if (!has_text)
+        {
+          err = collect (reader, "</text", &page->text, &page->text_len, &page->text_capacity);
+          if (err)
+            return err;
+
+          page->text_len = decode_entities (page->text, page->text_len);
+          has_text = true;
+        }
+    }
+
+  *found = true;
+
+  return skip_tag_end (reader, &self_closing);
+}
+
+/*
+ * Release memory and file descriptor.
+ */
+void
+xml_reader_close (xml_reader_t *reader)
+{
+  if (reader->file)
+    fclose (reader->file);
+
+  free (reader->buffer);
+  memset (reader, 0, sizeof *reader);
+}
+
+/*
+ * Release memory of `page`.
+ */
+void
+xml_page_release (xml_page_t *page)
+{
+  free (page->title);
+  free (page->text);
+  memset (page, 0, sizeof *page);
+}
@@ -0,0 +1,43 @@
+#ifndef _XML_READER_H_
+#define _XML_READER_H_
+
+/*
+ * Size of the window the dump is read into.
+ */
+#define XML_BUFFER_SIZE 65536
+
+/*
+ * Streaming reader for MediaWiki XML dumps (`pages-articles.xml`).
+ *
+ * Only a window of the file is kept in memory, so memory use is bounded
+ * by the size of the biggest page, not by the size of the dump.
+ */
+typedef struct {
+  FILE *file;
+  char *buffer;
+  size_t pos;
+  size_t len;
+  bool eof;
+} xml_reader_t;
+
+/*
+ * A page of the dump, with entities decoded.
+ *
+ * Both `title` and `text` are NUL terminated. Their memory belongs to
+ * the page and is reused when reading the next one in it.
+ */
+typedef struct {
+  char *title;
+  size_t title_len;
+  size_t title_capacity;
+  char *text;
+  size_t text_len;
+  size_t text_capacity;
+} xml_page_t;
+
+int xml_reader_open (xml_reader_t *reader, const char *filename);
+int xml_reader_next (xml_reader_t *reader, xml_page_t *page, bool *found);
+void xml_reader_close (xml_reader_t *reader);
+void xml_page_release (xml_page_t *page);
+
+#endif